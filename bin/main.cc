@@ -25,11 +25,19 @@
 #include "exitfail.h"
 #include "argmatch.h"
 
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <iterator>
+
 #include <spot/twaalgos/dot.hh>
 #include <spot/tl/parse.hh>
 #include <spot/tl/print.hh>
 #include <spot/twaalgos/translate.hh>
 #include <spot/twaalgos/emptiness.hh>
+#include <spot/twaalgos/stutter.hh>
+#include <spot/twa/twaproduct.hh>
 
 #include "tcltl.hh"
 
@@ -44,8 +52,28 @@ Exit status:\n\
 // We disable this option as well as -V (because --version doesn't need
 // a short version).
 enum {
-      OPT_DEAD = 256,
+      OPT_ACTIVE_CLOCKS = 256,
+      OPT_CEGAR,
+      OPT_CONVEX_HULL,
+      OPT_DEAD,
+      OPT_DEPTH,
+      OPT_EXPORT,
+      OPT_GUIDED,
       OPT_HELP,
+      OPT_NON_ZENO,
+      OPT_POR,
+      OPT_PROGRESS,
+      OPT_RESET_DEAD_VARS,
+      OPT_SEED,
+      OPT_SHORTEST,
+      OPT_SIMULATE,
+      OPT_SIM_STEPS,
+      OPT_STATS,
+      OPT_STUTTER,
+      OPT_SYMMETRY,
+      OPT_THREADS,
+      OPT_TIMED_RUN,
+      OPT_UNTIMED_FIRST,
       OPT_VARS,
       OPT_VERSION,
 };
@@ -54,7 +82,8 @@ static const argp_option options[] =
   {
     { nullptr, 0, nullptr, 0, "Input:", 1 },
     { "model", 'm', "FILENAME", 0,
-      "read the timed-automaton model in FILENAME (TChecker's syntax)", 0 },
+      "read the timed-automaton model in FILENAME (TChecker's syntax), "
+      "or from standard input if FILENAME is -", 0 },
     { "formula", 'f', "FORMULA", 0,
       "check the LTL on the model (Spot's syntax)", 0 },
     { nullptr, 0, nullptr, 0, "Output:", 2 },
@@ -62,17 +91,101 @@ static const argp_option options[] =
       "suppress standard output (check exit code for result)", 0 },
     { "dot", 'd', nullptr, 0,
       "output the result in GraphViz format" },
+    { "export", OPT_EXPORT, "dot|hoa|binary", 0,
+      "output the state space of the model (observing only the atomic "
+      "propositions of the formula, if any) as it is explored, without "
+      "checking the formula; this is much less memory hungry than -d on "
+      "large models", 0 },
+    { "progress", OPT_PROGRESS, "SECONDS", OPTION_ARG_OPTIONAL,
+      "while exploring, print the number of states built and the memory "
+      "used (as with --stats) on standard error every SECONDS seconds "
+      "(10 by default)", 0 },
+    { "stats", OPT_STATS, nullptr, 0,
+      "print statistics about the explored states on standard error "
+      "(number of states built, average number of active clocks, and "
+      "the memory used by zones, states, and BDDs)", 0 },
+    { "timed-run", OPT_TIMED_RUN, nullptr, 0,
+      "also print the delays and clock values along the counterexample, "
+      "as a JSON object where all times are multiples of 1/denominator",
+      0 },
     { "vars", OPT_VARS, nullptr, 0,
       "list variables in the model and exit", 0 },
     { nullptr, 0, nullptr, 0, "Semantic options:", 3 },
+    { "active-clocks", OPT_ACTIVE_CLOCKS, nullptr, 0,
+      "remove the constraints on clocks that the model will reset "
+      "before reading them (ignored with --non-zeno)", 0 },
     { "dead-loop", OPT_DEAD, "true|false|\"ap\"", 0,
       "handling of states without successors in the model: "
       "(false) ignore them, (true) loop on them, (\"ap\") loop and"
       " label them with an atomic proposition that may be used in "
       "the formula.  The default is true." },
+    { "non-zeno", OPT_NON_ZENO, nullptr, 0,
+      "ignore counterexamples along which time does not diverge (time "
+      "is only considered to progress when a clock that is at least 1 "
+      "gets reset, or when a dead state lets time elapse)", 0 },
+    { "por", OPT_POR, nullptr, 0,
+      "use partial-order reduction (only for stutter-invariant formulas; "
+      "this is ignored otherwise)", 0 },
+    { "reset-dead-vars", OPT_RESET_DEAD_VARS, nullptr, 0,
+      "reset integer variables to their initial value when the model "
+      "will not read them before assigning them again", 0 },
+    { "stutter", OPT_STUTTER, nullptr, 0,
+      "skip over the transitions that do not change the value of the "
+      "atomic propositions of the formula (only for stutter-invariant "
+      "formulas; this is ignored otherwise, and with --non-zeno)", 0 },
+    { "symmetry", OPT_SYMMETRY, nullptr, 0,
+      "reduce the state space by exploiting symmetries between processes "
+      "that are copies of each other (P1, P2, ...), except those "
+      "mentioned in the formula; counterexamples are then only valid up "
+      "to a permutation of these processes", 0 },
     { "zone-semantics", 'z', "SEMANTICS", 0,
       "specify the zone semantics to use (\"elapsed:extraLU+l\" "
-      "by default)", 0 },
+      "by default), or \"digital\" to use integer clock values (only for "
+      "models without strict clock constraints, whose clocks are only "
+      "compared to integer literals, and for stutter-invariant formulas; "
+      "it is ignored for other formulas)", 0 },
+    { nullptr, 0, nullptr, 0, "Search options:", 4 },
+    { "cegar", OPT_CEGAR, nullptr, 0,
+      "like --untimed-first, but replay each counterexample of the "
+      "abstraction on the model, add the clocks that make it "
+      "infeasible, and check again until the formula is proved or a "
+      "counterexample is genuine", 0 },
+    { "convex-hull", OPT_CONVEX_HULL, nullptr, 0,
+      "for formulas of the form G(p) or !F(q) with p and q Boolean, "
+      "first merge the zones of each discrete state into their convex "
+      "hull (an over-approximation), and only explore the zone graph if "
+      "this reaches a state violating p", 0 },
+    { "depth", OPT_DEPTH, "K", 0,
+      "only look for counterexamples whose states are at most K "
+      "transitions away from the initial state; if none is found, the "
+      "formula is only reported as not violated up to depth K (with exit "
+      "status 0)", 0 },
+    { "guided", OPT_GUIDED, nullptr, 0,
+      "for formulas whose negation is a reachability property (like "
+      "safety properties), explore first the states that are closest "
+      "to the locations and variable values of the formula, to find "
+      "counterexamples faster",
+      0 },
+    { "shortest", OPT_SHORTEST, nullptr, 0,
+      "report a counterexample with a shortest prefix, followed by a "
+      "short cycle; this explores the whole product", 0 },
+    { "untimed-first", OPT_UNTIMED_FIRST, nullptr, 0,
+      "first check the formula on the model without its clocks (an "
+      "over-approximation), and only explore the zone graph if this "
+      "yields a counterexample; not used with --dot, or with "
+      "--dead-loop=\"ap\"", 0 },
+    { nullptr, 0, nullptr, 0, "Simulation options:", 5 },
+    { "simulate", OPT_SIMULATE, "RUNS", 0,
+      "instead of checking the formula, perform RUNS random walks with "
+      "concrete clock values (random delays), and report how often the "
+      "atomic propositions of the formula hold", 0 },
+    { "sim-steps", OPT_SIM_STEPS, "STEPS", 0,
+      "maximal number of transitions of each random walk (1000 by "
+      "default)", 0 },
+    { "seed", OPT_SEED, "N", 0,
+      "seed of the random walks (0 by default)", 0 },
+    { "threads", OPT_THREADS, "N", 0,
+      "number of threads performing random walks (1 by default)", 0 },
     { nullptr, 0, nullptr, 0, "Miscellaneous options:", -1 },
     { "version", OPT_VERSION, nullptr, 0, "print program version", 0 },
     { "help", OPT_HELP, nullptr, 0, "print this help", 0 },
@@ -101,6 +214,7 @@ static char const *const zone_sem_args[] = {
    "non-elapsed:extraMl",
    "non-elapsed:extraM+g",
    "non-elapsed:extraM+l",
+   "digital",
    nullptr
 };
 
@@ -123,9 +237,19 @@ static zg_zone_semantics const zone_sem_vals[] = {
    non_elapsed_extraM_local,
    non_elapsed_extraMplus_global,
    non_elapsed_extraMplus_local,
+   digital,
 };
 ARGMATCH_VERIFY(zone_sem_args, zone_sem_vals);
 
+static char const *const export_args[] = {
+   "dot", "hoa", "binary", nullptr
+};
+
+static export_format const export_vals[] = {
+   export_dot, export_hoa, export_binary
+};
+ARGMATCH_VERIFY(export_args, export_vals);
+
 
 static void
 display_version(FILE *stream, struct argp_state*)
@@ -141,13 +265,29 @@ There is NO WARRANTY, to the extent permitted by law.\n", stream);
 }
 
 
-enum output_type_t { OUTPUT_STD, OUTPUT_DOT, OUTPUT_QUIET, OUTPUT_VARS };
+enum output_type_t { OUTPUT_STD, OUTPUT_DOT, OUTPUT_EXPORT, OUTPUT_QUIET,
+                     OUTPUT_VARS };
 static output_type_t output_type = OUTPUT_STD;
+static export_format export_fmt = export_dot;
 static std::string input_formula;
 static spot::formula formula_neg;
 static std::string model_filename;
 static spot::formula dead_prop = spot::formula::tt();
 static zg_zone_semantics zone_sem = elapsed_extraLUplus_local;
+static unsigned kripke_opts = kripke_default;
+static bool print_stats = false;
+static unsigned progress = 0;
+static bool guided = false;
+static bool untimed_first = false;
+static bool cegar = false;
+static bool convex_hull = false;
+static unsigned depth = 0;
+static bool shortest = false;
+static bool timed_run = false;
+static uint64_t sim_runs = 0;
+static unsigned sim_steps = 1000;
+static uint64_t sim_seed = 0;
+static unsigned sim_threads = 1;
 
 static void parse_formula(std::string f)
 {
@@ -160,6 +300,18 @@ static void parse_formula(std::string f)
   formula_neg = spot::formula::Not(pf.f);
 }
 
+static uint64_t parse_number(const char* opt, const char* arg,
+                             uint64_t min, uint64_t max)
+{
+  char* endptr;
+  errno = 0;
+  unsigned long long res = strtoull(arg, &endptr, 10);
+  if (*arg == '\0' || *arg == '-' || *endptr != '\0' || errno
+      || res < min || res > max)
+    error(2, 0, "invalid argument for %s: '%s'", opt, arg);
+  return res;
+}
+
 static int
 parse_opt(int key, char* arg, struct argp_state* state)
 {
@@ -184,6 +336,15 @@ parse_opt(int key, char* arg, struct argp_state* state)
       zone_sem = XARGMATCH("--zone-semantics", arg,
                            zone_sem_args, zone_sem_vals);
       break;
+    case OPT_ACTIVE_CLOCKS:
+      kripke_opts |= kripke_active_clocks;
+      break;
+    case OPT_CEGAR:
+      cegar = true;
+      break;
+    case OPT_CONVEX_HULL:
+      convex_hull = true;
+      break;
     case OPT_DEAD:
       if (!strcasecmp(arg, "true"))
         dead_prop = spot::formula::tt();
@@ -192,6 +353,16 @@ parse_opt(int key, char* arg, struct argp_state* state)
       else
         dead_prop = spot::formula::ap(arg);
       break;
+    case OPT_DEPTH:
+      depth = parse_number("--depth", arg, 1, UINT_MAX);
+      break;
+    case OPT_EXPORT:
+      output_type = OUTPUT_EXPORT;
+      export_fmt = XARGMATCH("--export", arg, export_args, export_vals);
+      break;
+    case OPT_GUIDED:
+      guided = true;
+      break;
     case OPT_HELP:
       argp_state_help(state, state->out_stream,
                       // Do not let argp exit: we want to diagnose a
@@ -201,6 +372,48 @@ parse_opt(int key, char* arg, struct argp_state* state)
       close_stdout();
       exit(0);
       break;
+    case OPT_NON_ZENO:
+      kripke_opts |= kripke_non_zeno;
+      break;
+    case OPT_POR:
+      kripke_opts |= kripke_por;
+      break;
+    case OPT_PROGRESS:
+      progress = arg ? parse_number("--progress", arg, 1, UINT_MAX) : 10;
+      break;
+    case OPT_RESET_DEAD_VARS:
+      kripke_opts |= kripke_dead_vars;
+      break;
+    case OPT_SEED:
+      sim_seed = parse_number("--seed", arg, 0, UINT64_MAX);
+      break;
+    case OPT_SHORTEST:
+      shortest = true;
+      break;
+    case OPT_SIMULATE:
+      sim_runs = parse_number("--simulate", arg, 1, UINT64_MAX);
+      break;
+    case OPT_SIM_STEPS:
+      sim_steps = parse_number("--sim-steps", arg, 0, UINT_MAX);
+      break;
+    case OPT_STATS:
+      print_stats = true;
+      break;
+    case OPT_STUTTER:
+      kripke_opts |= kripke_stutter;
+      break;
+    case OPT_SYMMETRY:
+      kripke_opts |= kripke_symmetry;
+      break;
+    case OPT_THREADS:
+      sim_threads = parse_number("--threads", arg, 1, 1024);
+      break;
+    case OPT_TIMED_RUN:
+      timed_run = true;
+      break;
+    case OPT_UNTIMED_FIRST:
+      untimed_first = true;
+      break;
     case OPT_VARS:
       output_type = OUTPUT_VARS;
       break;
@@ -223,54 +436,290 @@ parse_opt(int key, char* arg, struct argp_state* state)
   return 0;
 }
 
-static int run()
+static tc_model load_model()
 {
-  auto dict = spot::make_bdd_dict();
-  tc_model m = tc_model::load(model_filename);
-  std::string logs = m.get_logs();
-  if (!logs.empty())
-    std::cerr << logs;
+  if (model_filename != "-")
+    return tc_model::load(model_filename);
+  std::string text{std::istreambuf_iterator<char>(std::cin),
+                   std::istreambuf_iterator<char>()};
+  if (std::cin.bad())
+    error(2, 0, "error reading standard input");
+  return tc_model::load_from_string(text);
+}
 
-  if (!formula_neg
-      && output_type != OUTPUT_VARS
-      && output_type != OUTPUT_DOT)
+// Print the memory used by each component of the exploration.
+static void print_memory(const tc_kripke_stats& s)
+{
+  auto print = [](const char* name, const tc_memory_stats& m)
     {
-      std::cout << "No LTL formula specified.\n";
-      output_type = OUTPUT_VARS;
+      std::cerr << name << ": " << m.objects << " object(s), "
+                << m.bytes << " bytes (peak " << m.peak_bytes << ")\n";
+    };
+  print("zones", s.zones);
+  print("pending zones", s.pending_zones);
+  print("Kripke states", s.kripke_states);
+  print("product states", s.product_states);
+  std::cerr << "BDD nodes: " << bdd_getnodenum() << " used, "
+            << bdd_getallocnum() << " allocated\n";
+}
+
+static void report_stats(const spot::const_kripke_ptr& k)
+{
+  if (!print_stats)
+    return;
+  auto* s = k->get_named_prop<tc_kripke_stats>("tcltl-stats");
+  std::cerr << "states built: " << s->states << '\n';
+  if (s->states)
+    std::cerr << "average active clocks: "
+              << double(s->active_clocks) / s->states
+              << " (out of " << s->clocks << ")\n";
+  print_memory(*s);
+}
+
+// With --progress, report the exploration of K at most every
+// PROGRESS seconds.
+static void watch_progress(const spot::const_kripke_ptr& k)
+{
+  if (!progress)
+    return;
+  auto* s = k->get_named_prop<tc_kripke_stats>("tcltl-stats");
+  s->progress = [last = std::chrono::steady_clock::now()]
+    (const tc_kripke_stats& s) mutable
+    {
+      auto now = std::chrono::steady_clock::now();
+      if (now - last < std::chrono::seconds(progress))
+        return;
+      last = now;
+      std::cerr << "states built: " << s.states << '\n';
+      print_memory(s);
+    };
+}
+
+// Check AF on the untimed abstraction of M.  Return true if it has
+// no accepting run, i.e., the formula holds on M as well.  If REFINE
+// is set, replay each counterexample on M, add to the abstraction the
+// clocks that make it infeasible if it is spurious, and check again
+// until the formula is proved or a counterexample is genuine.  KEPT
+// is set to the number of clocks of the last abstraction.
+static bool abstract_precheck(const tc_model& m, spot::bdd_dict_ptr dict,
+                              const spot::atomic_prop_set& ap,
+                              const spot::twa_graph_ptr& af,
+                              bool refine, unsigned& kept)
+{
+  std::set<std::string> keep;
+  kept = 0;
+  try
+    {
+      for (;;)
+        {
+          // Dead states of M loop when dead_prop is true, but the
+          // corresponding states of the abstraction may have
+          // successors: let these stutter too.
+          tc_model u = m.untimed_abstraction(dead_prop.is_tt(), keep);
+          std::string logs = u.get_logs();
+          if (!logs.empty())
+            std::cerr << logs;
+          // Ignoring the acceptance of --non-zeno only adds runs.
+          // Counterexamples are replayed on M, so their steps must be
+          // transitions of the model.
+          unsigned opts = kripke_opts & ~kripke_non_zeno;
+          if (refine)
+            opts &= ~(kripke_stutter | kripke_symmetry | kripke_dead_vars);
+          auto k = u.kripke(&ap, dict, dead_prop, zone_sem, opts);
+          watch_progress(k);
+          spot::twa_run_ptr run = lazy_intersecting_run(k, af);
+          if (!run)
+            return true;
+          if (!refine)
+            return false;
+          std::set<std::string> add =
+            m.refine_clocks(*run, keep, dead_prop);
+          if (add.empty())
+            return false;
+          keep.insert(add.begin(), add.end());
+          kept = keep.size();
+        }
+    }
+  catch (const std::runtime_error& e)
+    {
+      error(0, 0, "skipping the %s check: %s",
+            refine ? "abstraction" : "untimed", e.what());
+      return false;
     }
+}
 
-  if (output_type == OUTPUT_VARS)
+// If F, the negation of the formula to check, says that some state
+// violating a Boolean formula is reachable (i.e., F is F(b) or !G(p),
+// with b = !p), return that Boolean formula, otherwise return
+// nullptr.
+static spot::formula bad_states(const spot::formula& f)
+{
+  if (f.is(spot::op::F) && f[0].is_boolean())
+    return f[0];
+  if (f.is(spot::op::Not) && f[0].is(spot::op::G) && f[0][0].is_boolean())
+    return spot::formula::Not(f[0][0]);
+  return nullptr;
+}
+
+// Check with tc_model::hull_reachable() that the states of BAD are
+// unreachable on M.  Return true if they are, i.e., the formula
+// holds.
+static bool hull_precheck(const tc_model& m, const spot::formula& bad)
+{
+  try
     {
-      m.dump_info(std::cout);
-      return 0;
+      return !m.hull_reachable(bad, zone_sem);
+    }
+  catch (const std::runtime_error& e)
+    {
+      error(0, 0, "skipping the convex-hull check: %s", e.what());
+      return false;
     }
+}
 
-  if (!formula_neg && output_type == OUTPUT_DOT)
+// Perform the random walks of --simulate on M.
+static void simulate(const tc_model& m)
+{
+  std::vector<std::string> names;
+  if (formula_neg)
     {
       spot::atomic_prop_set ap;
-      auto k = m.kripke(&ap, dict, dead_prop, zone_sem);
-      k->set_named_prop("automaton-name", new std::string(model_filename));
-      spot::print_dot(std::cout, k, ".kvA");
-      return 0;
+      spot::atomic_prop_collect(formula_neg, &ap);
+      for (auto& a: ap)
+        if (a != dead_prop)
+          names.push_back(a.ap_name());
+    }
+  tc_simulation r = m.simulate(names, sim_runs, sim_steps, sim_seed,
+                               sim_threads, zone_sem);
+  if (output_type == OUTPUT_QUIET)
+    return;
+  std::cout << "runs: " << r.runs << "\nsteps: " << r.steps
+            << "\ndeadlocks: " << r.deadlocks << '\n';
+  for (unsigned i = 0, n = names.size(); i < n; ++i)
+    std::cout << names[i] << ": held in " << r.runs_holding[i]
+              << " run(s), " << r.states_holding[i] << " state(s)\n";
+}
+
+// Print the timed counterpart of RUN, a run of K.
+static void print_timed(const spot::const_kripke_ptr& k,
+                        const spot::twa_run& run)
+{
+  auto tck = std::dynamic_pointer_cast<const tc_kripke>(k);
+  if (!tck)
+    return;
+  try
+    {
+      tc_timed_run tr = tck->timed_run(run);
+      std::cout << "timed run: ";
+      print_timed_run(std::cout, tr);
+      std::cout << '\n';
+    }
+  catch (const std::runtime_error& e)
+    {
+      error(0, 0, "cannot compute a timed run: %s", e.what());
+    }
+}
+
+// Check the formula on M, and print the result.
+static int check(tc_model& m, spot::bdd_dict_ptr dict)
+{
+  if (convex_hull && output_type != OUTPUT_DOT)
+    {
+      spot::formula bad = bad_states(formula_neg);
+      spot::atomic_prop_set bad_ap;
+      if (bad)
+        spot::atomic_prop_collect(bad, &bad_ap);
+      if (!bad || bad_ap.count(dead_prop))
+        error(0, 0, "ignoring --convex-hull since the formula is not "
+              "of the form G(p) with p Boolean");
+      else
+        {
+          bool proved = hull_precheck(m, bad);
+          if (output_type == OUTPUT_STD)
+            std::cout << "convex-hull check: "
+                      << (proved ? "satisfied" : "inconclusive") << '\n';
+          if (proved)
+            {
+              if (output_type == OUTPUT_STD)
+                std::cout << "formula is satisfied\n";
+              return 0;
+            }
+        }
     }
 
   spot::twa_graph_ptr af = spot::translator(dict).run(formula_neg);
   spot::atomic_prop_set ap;
   spot::atomic_prop_collect(formula_neg, &ap);
-  spot::twa_ptr k = m.kripke(&ap, dict, dead_prop, zone_sem);
+  // Remove the transitions of the property automaton that require
+  // propositions that the model can never satisfy together.
+  af = m.exclusive_aps(&ap).constrain(af, true);
+  af->purge_dead_states();
+
+  if ((untimed_first || cegar) && output_type != OUTPUT_DOT
+      && dead_prop.is_constant())
+    {
+      unsigned kept;
+      bool proved = abstract_precheck(m, dict, ap, af, cegar, kept);
+      if (output_type == OUTPUT_STD)
+        {
+          if (cegar)
+            std::cout << "abstraction check: "
+                      << (proved ? "satisfied" : "inconclusive")
+                      << " with " << kept << " clock(s)\n";
+          else
+            std::cout << "untimed check: "
+                      << (proved ? "satisfied" : "inconclusive") << '\n';
+        }
+      if (proved)
+        {
+          if (output_type == OUTPUT_STD)
+            std::cout << "formula is satisfied\n";
+          return 0;
+        }
+    }
+
+  spot::kripke_ptr kripke =
+    m.kripke(&ap, dict, dead_prop, zone_sem, kripke_opts);
+  watch_progress(kripke);
+  spot::twa_ptr k = kripke;
   if (output_type == OUTPUT_DOT)
     k = spot::make_twa_graph(k, spot::twa::prop_set::all(), true);
   int exit_code = 0;
-  auto run = k->intersecting_run(af);
+  spot::twa_run_ptr run;
+  // Whether the absence of counterexample proves the formula.
+  bool complete = true;
+  if (output_type == OUTPUT_DOT && shortest)
+    {
+      run = shortest_accepting_run(spot::otf_product(k, af));
+      if (run)
+        run = run->project(k);
+    }
+  else if (output_type == OUTPUT_DOT)
+    run = k->intersecting_run(af);
+  else if (shortest)
+    run = shortest_intersecting_run(kripke, af);
+  else if (depth)
+    run = bounded_intersecting_run(kripke, af, depth, &complete);
+  else if (guided)
+    run = guided_intersecting_run(kripke, af);
+  else
+    run = lazy_intersecting_run(kripke, af);
   exit_code = !!run;
+  report_stats(kripke);
   switch (output_type)
     {
     case OUTPUT_STD:
       if (run)
-        std::cout
-          << "formula is violated by the following run:\n" << *run;
-      else
+        {
+          std::cout
+            << "formula is violated by the following run:\n" << *run;
+          if (timed_run)
+            print_timed(kripke, *run);
+        }
+      else if (complete)
         std::cout << "formula is satisfied\n";
+      else
+        std::cout << "no counterexample up to depth " << depth << '\n';
       break;
     case OUTPUT_QUIET:
       break;
@@ -292,6 +741,7 @@ static int run()
         }
       spot::print_dot(std::cout, k, ".kvAn");
       break;
+    case OUTPUT_EXPORT:
     case OUTPUT_VARS:
       /* unreachable */
       break;
@@ -299,6 +749,87 @@ static int run()
   return exit_code;
 }
 
+static int run()
+{
+  auto dict = spot::make_bdd_dict();
+  tc_model m = load_model();
+  std::string logs = m.get_logs();
+  if (!logs.empty())
+    std::cerr << logs;
+
+  if (sim_runs)
+    {
+      simulate(m);
+      return 0;
+    }
+
+  if (!formula_neg
+      && output_type != OUTPUT_VARS
+      && output_type != OUTPUT_DOT
+      && output_type != OUTPUT_EXPORT)
+    {
+      std::cout << "No LTL formula specified.\n";
+      output_type = OUTPUT_VARS;
+    }
+
+  if (output_type == OUTPUT_VARS)
+    {
+      m.dump_info(std::cout);
+      return 0;
+    }
+
+  // Let complementary propositions such as x==1 and x!=1 share one
+  // atomic proposition.
+  if (formula_neg)
+    formula_neg = m.normalize_aps(formula_neg, dead_prop);
+
+  if (((kripke_opts & (kripke_por | kripke_stutter)) || zone_sem == digital)
+      && formula_neg && !spot::is_stutter_invariant(formula_neg))
+    {
+      if (kripke_opts & kripke_por)
+        error(0, 0, "ignoring --por since the formula is not "
+              "stutter-invariant");
+      if (kripke_opts & kripke_stutter)
+        error(0, 0, "ignoring --stutter since the formula is not "
+              "stutter-invariant");
+      kripke_opts &= ~(kripke_por | kripke_stutter);
+      // The digital semantics lets time elapse through transitions
+      // that do not change the atomic propositions, which only
+      // stutter-invariant formulas cannot see.
+      if (zone_sem == digital)
+        {
+          error(0, 0, "ignoring -z digital since the formula is not "
+                "stutter-invariant");
+          zone_sem = elapsed_extraLUplus_local;
+        }
+    }
+
+  if (output_type == OUTPUT_EXPORT)
+    {
+      spot::atomic_prop_set ap;
+      if (formula_neg)
+        spot::atomic_prop_collect(formula_neg, &ap);
+      auto k = m.kripke(&ap, dict, dead_prop, zone_sem, kripke_opts);
+      watch_progress(k);
+      export_kripke(std::cout, k, export_fmt, model_filename);
+      report_stats(k);
+      return 0;
+    }
+
+  if (!formula_neg && output_type == OUTPUT_DOT)
+    {
+      spot::atomic_prop_set ap;
+      auto k = m.kripke(&ap, dict, dead_prop, zone_sem, kripke_opts);
+      watch_progress(k);
+      k->set_named_prop("automaton-name", new std::string(model_filename));
+      spot::print_dot(std::cout, k, ".kvA");
+      report_stats(k);
+      return 0;
+    }
+
+  return check(m, dict);
+}
+
 
 
 int main(int argc, char * argv[])
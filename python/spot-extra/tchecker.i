@@ -17,7 +17,15 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
-%module(package="spot", director="1") tchecker
+%module(package="spot", director="1", threads="1") tchecker
+
+// Only release the GIL for the functions that do not touch Python
+// objects or BDDs (see the "Thread safety" comment in tcltl.hh).
+// Everything else keeps the GIL, because BuDDy is not thread-safe.
+%nothread;
+%thread tc_model::load;
+%thread tc_model::load_from_string;
+%thread tc_model::explore;
 
 %include "std_string.i"
 %include "exception.i"
@@ -28,9 +36,22 @@
 %shared_ptr(spot::twa)
 %shared_ptr(spot::kripke)
 %shared_ptr(spot::fair_kripke)
+%shared_ptr(tc_kripke)
+%shared_ptr(tc_state_space)
 
 %{
 #include <tcltl.hh>
+
+// Expose the contents of V as a read-only memoryview, without copy.
+// The memoryview does not own the memory: it is only valid as long as
+// the C++ object holding V is alive.
+template <typename T>
+static PyObject* tcltl_memoryview(std::vector<T>& v)
+{
+  static char empty;
+  char* data = v.empty() ? &empty : reinterpret_cast<char*>(v.data());
+  return PyMemoryView_FromMemory(data, v.size() * sizeof(T), PyBUF_READ);
+}
 %}
 
 %import(module="spot.impl") <spot/misc/common.hh>
@@ -59,14 +80,24 @@
 
 %rename(model) tc_model;
 %rename(kripke_raw) tc_model::kripke;
+%rename(state_space) tc_state_space;
+%ignore tc_state_space::offsets;
+%ignore tc_state_space::succ;
+%ignore tc_state_space::locations;
+%ignore tc_state_space::intvars;
 %include <tcltl.hh>
 
+%extend tc_state_space {
+  PyObject* offsets_buffer() { return tcltl_memoryview($self->offsets); }
+  PyObject* succ_buffer() { return tcltl_memoryview($self->succ); }
+  PyObject* locations_buffer() { return tcltl_memoryview($self->locations); }
+  PyObject* intvars_buffer() { return tcltl_memoryview($self->intvars); }
+}
+
 %pythoncode %{
 import spot
-import spot.aux
 import sys
 import subprocess
-import tempfile
 
 def load(filename):
   """Load a TChecker model.
@@ -74,18 +105,12 @@ def load(filename):
 The argument is assumed to be a filename if it contains no newline.
 Otherwise it is assumed to be the actual text of the model.
 """
-  if '\n' in filename:
-    # Assume it's an actual model.
-    with spot.aux.tmpdir():
-       with tempfile.NamedTemporaryFile(dir='.', suffix='.tc') as t:
-           # See ticktac-project/tchecker#35
-           if filename[-1] != '\n':
-               filename += '\n'
-           t.write(filename.encode('utf-8'))
-           t.flush()
-           return load(t.name)
   try:
-    m = model.load(filename)
+    if '\n' in filename:
+      # Assume it's an actual model.
+      m = model.load_from_string(filename)
+    else:
+      m = model.load(filename)
     logs = m.get_logs()
     if logs:
       print(logs, end='', file=sys.stderr)
@@ -98,11 +123,11 @@ Otherwise it is assumed to be the actual text of the model.
 class model:
   def kripke(self, ap_set, dict=spot._bdd_dict,
              dead=spot.formula_ap('dead'),
-             zone_sem=elapsed_extraLUplus_local):
+             zone_sem=elapsed_extraLUplus_local, opts=kripke_default):
     s = spot.atomic_prop_set()
     for ap in ap_set:
       s.insert(spot.formula_ap(ap))
-    return self.kripke_raw(s, dict, dead, zone_sem)
+    return self.kripke_raw(s, dict, dead, zone_sem, opts)
 
   def __repr__(self):
     res = "tchecker model\n";
@@ -110,6 +135,43 @@ class model:
     self.dump_info(ostr)
     return res + ostr.str()
 
+@spot._extend(state_space)
+class state_space:
+  def _array(self, buf, dtype, width=None):
+    import numpy
+    # Subclassing ndarray lets us attach the owner of the memory to
+    # the array, so that it cannot be freed while the array (or any
+    # view of it) is alive.
+    class owned_array(numpy.ndarray):
+      pass
+    a = numpy.frombuffer(buf, dtype=dtype).view(owned_array)
+    a._owner = self
+    if width is not None:
+      a = a.reshape(self.num_states, width)
+    return a
+
+  def arrays(self):
+    """Return the explored graph as a dictionary of NumPy arrays.
+
+The arrays share the memory of this object (there is no copy):
+'offsets' and 'succ' hold the graph in CSR format, 'locations' has
+one row per state and one column per process, and 'intvars' has one
+row per state and one column per integer variable.
+"""
+    import numpy
+    return {
+      'offsets': self._array(self.offsets_buffer(), numpy.uint32),
+      'succ': self._array(self.succ_buffer(), numpy.uint32),
+      'locations': self._array(self.locations_buffer(), numpy.uint32,
+                               self.num_processes),
+      'intvars': self._array(self.intvars_buffer(), numpy.int32,
+                             self.num_intvars),
+    }
+
+  def __repr__(self):
+    return "tchecker state space ({} states, {} edges)".format(
+      self.num_states, len(self.succ_buffer()) // 4)
+
 # Load IPython specific support if we can.
 try:
     # Load only if we are running IPython.
@@ -0,0 +1,401 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2019 Laboratoire de Recherche et Développement
+// de l'Epita (LRDE).
+//
+// This file is part of TCLTL, a model checker for timed-automata.
+//
+// TCLTL is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// TCLTL is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+// License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "config.h"
+#include <iostream>
+#include <deque>
+#include <unordered_map>
+
+#include <spot/twa/bddprint.hh>
+
+#include "tcltl.hh"
+
+namespace
+{
+  // Output STR between double quotes, escaping double quotes and
+  // backslashes, and writing newlines as the two characters "\n", as
+  // expected by GraphViz and HOA.
+  void print_quoted(std::ostream& out, const std::string& str)
+  {
+    out << '"';
+    for (char c: str)
+      switch (c)
+        {
+        case '"':
+        case '\\':
+          out << '\\' << c;
+          break;
+        case '\n':
+          out << "\\n";
+          break;
+        default:
+          out << c;
+        }
+    out << '"';
+  }
+
+  void put_u32(std::ostream& out, uint32_t v)
+  {
+    char buf[4] = { char(v), char(v >> 8), char(v >> 16), char(v >> 24) };
+    out.write(buf, 4);
+  }
+
+  // A breadth-first exploration of a Kripke structure, calling
+  // the visitor for each state and transition.  The visitor has to
+  // provide the following methods:
+  //
+  //   void start(const std::vector<spot::formula>& aps);
+  //   void state(unsigned num, const spot::state* s, bdd label);
+  //   void edge(unsigned src, unsigned dst, spot::acc_cond::mark_t acc);
+  //   void end_state(unsigned num);
+  //   void end();
+  //
+  // Edges are reported between the state() and end_state() calls
+  // of their source.  The label given to state() is the condition
+  // of the outgoing transitions of the state (this differs from
+  // state_condition() on dead states, see tc_model::kripke()).
+  template<typename VISITOR>
+  void bfs_export(const spot::const_kripke_ptr& k, VISITOR& v)
+  {
+    std::unordered_map<const spot::state*, unsigned,
+                       spot::state_ptr_hash, spot::state_ptr_equal> seen;
+    std::deque<const spot::state*> todo;
+
+    auto number = [&](const spot::state* s) -> unsigned
+      {
+        auto [it, inserted] = seen.emplace(s, seen.size());
+        if (inserted)
+          todo.push_back(s);
+        else
+          s->destroy();
+        return it->second;
+      };
+
+    v.start(k->ap());
+    number(k->get_init_state());
+    unsigned src = 0;
+    while (!todo.empty())
+      {
+        const spot::state* s = todo.front();
+        todo.pop_front();
+        spot::twa_succ_iterator* it = k->succ_iter(s);
+        bool labeled = false;
+        for (it->first(); !it->done(); it->next())
+          {
+            if (!labeled)
+              {
+                v.state(src, s, it->cond());
+                labeled = true;
+              }
+            v.edge(src, number(it->dst()), it->acc());
+          }
+        if (!labeled)
+          v.state(src, s, k->state_condition(s));
+        k->release_iter(it);
+        v.end_state(src);
+        ++src;
+      }
+    v.end();
+
+    for (auto& p: seen)
+      p.first->destroy();
+  }
+
+  // Map each atomic proposition of a Kripke structure to its BDD
+  // variable.
+  std::vector<int> ap_vars(const spot::const_kripke_ptr& k)
+  {
+    std::vector<int> res;
+    auto dict = k->get_dict();
+    for (auto& ap: k->ap())
+      res.push_back(dict->has_registered_proposition(ap, k.get()));
+    return res;
+  }
+
+  class dot_visitor final
+  {
+    std::ostream& out_;
+    const spot::const_kripke_ptr& k_;
+    const std::string& name_;
+  public:
+    dot_visitor(std::ostream& out, const spot::const_kripke_ptr& k,
+                const std::string& name)
+      : out_(out), k_(k), name_(name)
+    {
+    }
+
+    void start(const std::vector<spot::formula>&)
+    {
+      out_ << "digraph ";
+      print_quoted(out_, name_);
+      out_ << " {\n  rankdir=LR\n";
+      if (!name_.empty())
+        {
+          out_ << "  label=";
+          print_quoted(out_, name_);
+          out_ << "\n  labelloc=\"t\"\n";
+        }
+      out_ << ("  node [shape=\"box\", style=\"rounded\"]\n"
+               "  I [label=\"\", style=invis, width=0]\n"
+               "  I -> 0\n");
+    }
+
+    void state(unsigned num, const spot::state* s, bdd label)
+    {
+      out_ << "  " << num << " [label=";
+      print_quoted(out_, k_->format_state(s) + '\n'
+                   + spot::bdd_format_formula(k_->get_dict(), label));
+      out_ << "]\n";
+    }
+
+    void edge(unsigned src, unsigned dst, spot::acc_cond::mark_t acc)
+    {
+      out_ << "  " << src << " -> " << dst;
+      if (acc)
+        {
+          const char* sep = " [label=\"{";
+          for (unsigned i = 0, n = k_->num_sets(); i < n; ++i)
+            if (acc.has(i))
+              {
+                out_ << sep << i;
+                sep = ",";
+              }
+          out_ << "}\"]";
+        }
+      out_ << '\n';
+    }
+
+    void end_state(unsigned)
+    {
+    }
+
+    void end()
+    {
+      out_ << "}\n";
+    }
+  };
+
+  class hoa_visitor final
+  {
+    std::ostream& out_;
+    const spot::const_kripke_ptr& k_;
+    const std::string& name_;
+    std::vector<int> vars_;
+  public:
+    hoa_visitor(std::ostream& out, const spot::const_kripke_ptr& k,
+                const std::string& name)
+      : out_(out), k_(k), name_(name), vars_(ap_vars(k))
+    {
+    }
+
+    void start(const std::vector<spot::formula>& aps)
+    {
+      out_ << "HOA: v1\n";
+      if (!name_.empty())
+        {
+          out_ << "name: ";
+          print_quoted(out_, name_);
+          out_ << '\n';
+        }
+      out_ << "Start: 0\nAP: " << aps.size();
+      for (auto& ap: aps)
+        {
+          out_ << ' ';
+          print_quoted(out_, ap.ap_name());
+        }
+      unsigned n = k_->num_sets();
+      if (n == 0)
+        {
+          out_ << "\nacc-name: all\nAcceptance: 0 t\n";
+        }
+      else
+        {
+          if (n == 1)
+            out_ << "\nacc-name: Buchi";
+          else
+            out_ << "\nacc-name: generalized-Buchi " << n;
+          out_ << "\nAcceptance: " << n;
+          for (unsigned i = 0; i < n; ++i)
+            out_ << (i ? "&Inf(" : " Inf(") << i << ')';
+          out_ << '\n';
+        }
+      out_ << "properties: state-labels explicit-labels\n--BODY--\n";
+    }
+
+    void state(unsigned num, const spot::state* s, bdd label)
+    {
+      out_ << "State: [";
+      if (label == bddfalse)
+        {
+          out_ << 'f';
+        }
+      else
+        {
+          bool first = true;
+          for (unsigned i = 0, n = vars_.size(); i < n; ++i)
+            {
+              if (vars_[i] < 0)
+                continue;
+              const char* neg;
+              if (bdd_implies(label, bdd_ithvar(vars_[i])))
+                neg = "";
+              else if (bdd_implies(label, bdd_nithvar(vars_[i])))
+                neg = "!";
+              else
+                continue;
+              out_ << (first ? "" : "&") << neg << i;
+              first = false;
+            }
+          if (first)
+            out_ << 't';
+        }
+      out_ << "] " << num << ' ';
+      print_quoted(out_, k_->format_state(s));
+      out_ << '\n';
+    }
+
+    void edge(unsigned, unsigned dst, spot::acc_cond::mark_t acc)
+    {
+      out_ << dst;
+      if (acc)
+        {
+          const char* sep = " {";
+          for (unsigned i = 0, n = k_->num_sets(); i < n; ++i)
+            if (acc.has(i))
+              {
+                out_ << sep << i;
+                sep = " ";
+              }
+          out_ << '}';
+        }
+      out_ << '\n';
+    }
+
+    void end_state(unsigned)
+    {
+    }
+
+    void end()
+    {
+      out_ << "--END--\n";
+    }
+  };
+
+  class binary_visitor final
+  {
+    std::ostream& out_;
+    const spot::const_kripke_ptr& k_;
+    std::vector<int> vars_;
+    unsigned num_sets_;
+    // Successors of the current state, with their acceptance marks,
+    // as we need to output their number first.
+    std::vector<uint32_t> succ_;
+    std::string bits_;
+  public:
+    binary_visitor(std::ostream& out, const spot::const_kripke_ptr& k)
+      : out_(out), k_(k), vars_(ap_vars(k)), num_sets_(k->num_sets())
+    {
+    }
+
+    void start(const std::vector<spot::formula>& aps)
+    {
+      out_.write("TCLTLKS1", 8);
+      put_u32(out_, aps.size());
+      put_u32(out_, num_sets_);
+      for (auto& ap: aps)
+        {
+          const std::string& n = ap.ap_name();
+          put_u32(out_, n.size());
+          out_.write(n.data(), n.size());
+        }
+    }
+
+    void state(unsigned, const spot::state*, bdd label)
+    {
+      unsigned n = vars_.size();
+      unsigned nbytes = (n + 7) / 8;
+      bits_.assign(2 * nbytes, '\0');
+      if (label != bddfalse)
+        for (unsigned i = 0; i < n; ++i)
+          {
+            if (vars_[i] < 0)
+              continue;
+            if (bdd_implies(label, bdd_ithvar(vars_[i])))
+              bits_[i / 8] |= 1 << (i % 8);
+            else if (bdd_implies(label, bdd_nithvar(vars_[i])))
+              bits_[nbytes + i / 8] |= 1 << (i % 8);
+          }
+      out_.write(bits_.data(), bits_.size());
+      succ_.clear();
+    }
+
+    void edge(unsigned, unsigned dst, spot::acc_cond::mark_t acc)
+    {
+      succ_.push_back(dst);
+      if (num_sets_)
+        {
+          uint32_t m = 0;
+          for (unsigned i = 0; i < num_sets_ && i < 32; ++i)
+            if (acc.has(i))
+              m |= 1U << i;
+          succ_.push_back(m);
+        }
+    }
+
+    void end_state(unsigned)
+    {
+      put_u32(out_, num_sets_ ? succ_.size() / 2 : succ_.size());
+      for (uint32_t v: succ_)
+        put_u32(out_, v);
+    }
+
+    void end()
+    {
+    }
+  };
+}
+
+void export_kripke(std::ostream& out, const spot::const_kripke_ptr& k,
+                   export_format fmt, const std::string& name)
+{
+  switch (fmt)
+    {
+    case export_dot:
+      {
+        dot_visitor v(out, k, name);
+        bfs_export(k, v);
+        break;
+      }
+    case export_hoa:
+      {
+        hoa_visitor v(out, k, name);
+        bfs_export(k, v);
+        break;
+      }
+    case export_binary:
+      {
+        if (k->num_sets() > 32)
+          throw std::runtime_error("export_kripke: the binary format "
+                                   "supports at most 32 acceptance sets");
+        binary_visitor v(out, k);
+        bfs_export(k, v);
+        break;
+      }
+    }
+}
@@ -0,0 +1,879 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2019 Laboratoire de Recherche et Développement
+// de l'Epita (LRDE).
+//
+// This file is part of TCLTL, a model checker for timed-automata.
+//
+// TCLTL is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// TCLTL is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+// License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "config.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include "modelinfo.hh"
+
+static std::string trim(const std::string& s)
+{
+  size_t b = s.find_first_not_of(" \t\r");
+  if (b == std::string::npos)
+    return "";
+  size_t e = s.find_last_not_of(" \t\r");
+  return s.substr(b, e - b + 1);
+}
+
+static std::vector<std::string> split(const std::string& s, char sep)
+{
+  std::vector<std::string> res;
+  size_t start = 0;
+  for (;;)
+    {
+      size_t pos = s.find(sep, start);
+      res.push_back(trim(s.substr(start, pos - start)));
+      if (pos == std::string::npos)
+        return res;
+      start = pos + 1;
+    }
+}
+
+std::string tc_declaration::attribute(const std::string& key) const
+{
+  for (auto& [k, v]: attributes)
+    if (k == key)
+      return v;
+  return "";
+}
+
+tc_declarations tc_parse_declarations(const std::string& text)
+{
+  tc_declarations res;
+  std::istringstream in(text);
+  std::string line;
+  while (std::getline(in, line))
+    {
+      size_t pos = line.find('#');
+      if (pos != std::string::npos)
+        line.erase(pos);
+      std::string attrs;
+      pos = line.find('{');
+      if (pos != std::string::npos)
+        {
+          size_t end = line.rfind('}');
+          if (end == std::string::npos || end < pos)
+            end = line.size();
+          attrs = line.substr(pos + 1, end - pos - 1);
+          line.erase(pos);
+        }
+      tc_declaration d;
+      d.fields = split(line, ':');
+      if (d.fields.front().empty())
+        continue;
+      if (!trim(attrs).empty())
+        {
+          // Attributes are "key: value : key: value ...".
+          std::vector<std::string> parts = split(attrs, ':');
+          for (size_t i = 0; i < parts.size(); i += 2)
+            d.attributes.emplace_back(parts[i], i + 1 < parts.size()
+                                      ? parts[i + 1] : "");
+        }
+      res.push_back(std::move(d));
+    }
+  return res;
+}
+
+namespace
+{
+  bool is_ident_char(char c)
+  {
+    return isalnum(static_cast<unsigned char>(c)) || c == '_';
+  }
+
+  bool is_ident_start(char c)
+  {
+    return isalpha(static_cast<unsigned char>(c)) || c == '_';
+  }
+
+  // Call F on each identifier of S.
+  template<typename F>
+  void for_each_identifier(const std::string& s, F f)
+  {
+    size_t n = s.size();
+    size_t i = 0;
+    while (i < n)
+      {
+        if (!is_ident_char(s[i]))
+          {
+            ++i;
+            continue;
+          }
+        size_t j = i;
+        while (j < n && is_ident_char(s[j]))
+          ++j;
+        if (is_ident_start(s[i]))
+          f(s.substr(i, j - i));
+        i = j;
+      }
+  }
+
+  // Position of the assignment operator in STATEMENT, or npos.
+  size_t find_assignment(const std::string& statement)
+  {
+    for (size_t i = 0; i < statement.size(); ++i)
+      if (statement[i] == '=')
+        {
+          if (i + 1 < statement.size() && statement[i + 1] == '=')
+            {
+              ++i;
+              continue;
+            }
+          if (i > 0 && strchr("<>!=", statement[i - 1]))
+            continue;
+          return i;
+        }
+    return std::string::npos;
+  }
+}
+
+tc_model_info::tc_model_info(const tc_declarations& decls)
+{
+  // First pass: global declarations.
+  std::set<std::string> synced;
+  for (auto& d: decls)
+    {
+      const std::string& k = d.kind();
+      if (k == "process" && d.fields.size() > 1)
+        processes.push_back(d.fields[1]);
+      else if (k == "clock" && d.fields.size() > 2)
+        clocks.insert(d.fields[2]);
+      else if (k == "int" && d.fields.size() > 5)
+        intvars.insert(d.fields[5]);
+      else if (k == "sync")
+        for (size_t i = 1; i < d.fields.size(); ++i)
+          {
+            std::string s = d.fields[i];
+            // Weak synchronizations are marked by a trailing "?".
+            if (!s.empty() && s.back() == '?')
+              s.pop_back();
+            synced.insert(s);
+          }
+    }
+
+  // Sort the identifiers of EXPR into integer variables and clocks.
+  auto classify = [this](const std::string& expr,
+                         std::set<std::string>& vars,
+                         std::set<std::string>& clks)
+    {
+      for_each_identifier(expr, [&](const std::string& id)
+                          {
+                            if (intvars.count(id))
+                              vars.insert(id);
+                            else if (clocks.count(id))
+                              clks.insert(id);
+                          });
+    };
+
+  for (auto& d: decls)
+    if (d.kind() == "location" && d.fields.size() > 2)
+      {
+        tc_location_info l;
+        l.process = d.fields[1];
+        l.name = d.fields[2];
+        for (auto& [key, value]: d.attributes)
+          if (key == "initial")
+            l.initial = true;
+          else if (key == "committed")
+            l.committed = true;
+          else if (key == "urgent")
+            l.urgent = true;
+          else if (key == "invariant")
+            l.invariant = value;
+        classify(l.invariant, l.reads, l.clocks);
+        locations.push_back(std::move(l));
+      }
+    else if (d.kind() == "edge" && d.fields.size() > 4)
+      {
+        tc_edge_info e;
+        e.process = d.fields[1];
+        e.src = d.fields[2];
+        e.tgt = d.fields[3];
+        e.event = d.fields[4];
+        e.synchronized = synced.count(e.process + '@' + e.event);
+        classify(d.attribute("provided"), e.reads, e.clock_guards);
+        std::string upd = d.attribute("do");
+        size_t start = 0;
+        while (start <= upd.size())
+          {
+            size_t end = upd.find(';', start);
+            if (end == std::string::npos)
+              end = upd.size();
+            std::string stmt = upd.substr(start, end - start);
+            start = end + 1;
+            size_t eq = find_assignment(stmt);
+            if (eq == std::string::npos)
+              {
+                std::set<std::string> unused;
+                classify(stmt, e.reads, unused);
+                continue;
+              }
+            // The first identifier of the left-hand side is assigned,
+            // the others (in array indices) are read.  Assigning one
+            // element of an array (of integers or of clocks) leaves
+            // the other elements unchanged, so the array also counts
+            // as read: the analyses of live variables and active
+            // clocks then never consider it dead before the edge.
+            std::string lhs = stmt.substr(0, eq);
+            bool indexed = lhs.find('[') != std::string::npos;
+            bool first = true;
+            for_each_identifier(lhs, [&](const std::string& id)
+                                {
+                                  if (first)
+                                    {
+                                      if (intvars.count(id))
+                                        {
+                                          e.writes.insert(id);
+                                          if (indexed)
+                                            e.reads.insert(id);
+                                        }
+                                      else if (clocks.count(id))
+                                        {
+                                          e.clock_resets.insert(id);
+                                          if (indexed)
+                                            e.clock_guards.insert(id);
+                                        }
+                                      first = false;
+                                    }
+                                  else if (intvars.count(id))
+                                    {
+                                      e.reads.insert(id);
+                                    }
+                                });
+            std::set<std::string> rhs_clocks;
+            classify(stmt.substr(eq + 1), e.reads, rhs_clocks);
+            // Clock assignments like x=y also count as resets of x;
+            // the clocks read by them only matter for the analyses of
+            // active clocks, which treat them as guards.
+            e.clock_guards.insert(rhs_clocks.begin(), rhs_clocks.end());
+          }
+        edges.push_back(std::move(e));
+      }
+}
+
+namespace
+{
+  // Remove the conjuncts of EXPR that mention clocks.
+  std::string strip_clocks(const std::string& expr,
+                           const std::set<std::string>& clocks)
+  {
+    std::string res;
+    size_t start = 0;
+    while (start <= expr.size())
+      {
+        size_t end = expr.find("&&", start);
+        if (end == std::string::npos)
+          end = expr.size();
+        std::string atom = trim(expr.substr(start, end - start));
+        start = end + 2;
+        bool timed = false;
+        for_each_identifier(atom, [&](const std::string& id)
+                            {
+                              timed |= clocks.count(id) > 0;
+                            });
+        if (timed || atom.empty())
+          continue;
+        if (!res.empty())
+          res += " && ";
+        res += atom;
+      }
+    return res;
+  }
+
+  // Remove the assignments of clocks from the updates UPD.
+  std::string strip_resets(const std::string& upd,
+                           const std::set<std::string>& clocks)
+  {
+    std::string res;
+    for (auto& stmt: split(upd, ';'))
+      {
+        size_t eq = find_assignment(stmt);
+        bool reset = false;
+        if (eq != std::string::npos)
+          {
+            bool first = true;
+            for_each_identifier(stmt.substr(0, eq),
+                                [&](const std::string& id)
+                                {
+                                  if (first)
+                                    reset = clocks.count(id) > 0;
+                                  first = false;
+                                });
+          }
+        if (reset || stmt.empty())
+          continue;
+        if (!res.empty())
+          res += "; ";
+        res += stmt;
+      }
+    return res;
+  }
+}
+
+std::string tc_untimed_model(const tc_declarations& decls, bool stutter,
+                             const std::set<std::string>& keep)
+{
+  std::set<std::string> clocks;
+  for (auto& d: decls)
+    if (d.kind() == "clock" && d.fields.size() > 2
+        && !keep.count(d.fields[2]))
+      clocks.insert(d.fields[2]);
+
+  std::ostringstream out;
+  for (auto& d: decls)
+    {
+      if (d.kind() == "clock" && d.fields.size() > 2
+          && clocks.count(d.fields[2]))
+        continue;
+      const char* sep = "";
+      for (auto& f: d.fields)
+        {
+          out << sep << f;
+          sep = ":";
+        }
+      std::vector<std::pair<std::string, std::string>> attrs;
+      for (auto& [key, value]: d.attributes)
+        if (key == "invariant" || key == "provided")
+          {
+            std::string v = strip_clocks(value, clocks);
+            if (!v.empty())
+              attrs.emplace_back(key, v);
+          }
+        else if (key == "do")
+          {
+            std::string v = strip_resets(value, clocks);
+            if (!v.empty())
+              attrs.emplace_back(key, v);
+          }
+        else
+          {
+            attrs.emplace_back(key, value);
+          }
+      if (!attrs.empty())
+        {
+          sep = "{";
+          for (auto& [key, value]: attrs)
+            {
+              out << sep << key << ':' << value;
+              sep = " : ";
+            }
+          out << '}';
+        }
+      else if (d.kind() == "location" || d.kind() == "edge")
+        {
+          out << "{}";
+        }
+      out << '\n';
+    }
+  if (stutter)
+    out << ("event:tcltl_untimed_tau\n"
+            "process:tcltl_untimed_stutter\n"
+            "location:tcltl_untimed_stutter:s{initial:}\n"
+            "edge:tcltl_untimed_stutter:s:s:tcltl_untimed_tau{}\n");
+  return out.str();
+}
+
+namespace
+{
+  // Call F on each clock of EXPR, with the position and length of its
+  // occurrence, including array indices.
+  template<typename F>
+  void for_each_clock(const std::string& expr,
+                      const std::set<std::string>& clocks, F f)
+  {
+    size_t n = expr.size();
+    size_t i = 0;
+    while (i < n)
+      {
+        if (!is_ident_char(expr[i]))
+          {
+            ++i;
+            continue;
+          }
+        size_t j = i;
+        while (j < n && is_ident_char(expr[j]))
+          ++j;
+        if (is_ident_start(expr[i]) && clocks.count(expr.substr(i, j - i)))
+          {
+            size_t k = j;
+            while (k < n && (expr[k] == ' ' || expr[k] == '\t'))
+              ++k;
+            if (k < n && expr[k] == '[')
+              {
+                int depth = 0;
+                for (; k < n; ++k)
+                  if (expr[k] == '[')
+                    ++depth;
+                  else if (expr[k] == ']' && !--depth)
+                    break;
+                j = std::min(k + 1, n);
+              }
+            f(i, j - i);
+          }
+        i = j;
+      }
+  }
+
+  // Replace each clock x of EXPR by (x+1).
+  std::string shift_clocks(const std::string& expr,
+                           const std::set<std::string>& clocks)
+  {
+    std::string res;
+    size_t last = 0;
+    for_each_clock(expr, clocks, [&](size_t pos, size_t len)
+                   {
+                     res += expr.substr(last, pos - last);
+                     res += '(' + expr.substr(pos, len) + "+1)";
+                     last = pos + len;
+                   });
+    return res + expr.substr(last);
+  }
+
+  // Whether EXPR is exactly one clock (or cell of a clock array).
+  bool is_clock(const std::string& expr, const std::set<std::string>& clocks)
+  {
+    bool res = false;
+    for_each_clock(expr, clocks, [&](size_t pos, size_t len)
+                   {
+                     res = pos == 0 && len == expr.size();
+                   });
+    return res;
+  }
+
+  bool is_literal(const std::string& expr)
+  {
+    return !expr.empty()
+      && std::all_of(expr.begin(), expr.end(), [](char c)
+                     {
+                       return isdigit(static_cast<unsigned char>(c));
+                     });
+  }
+
+  // Check that the clock constraint ATOM (or the update, if UPDATE is
+  // set) can be handled by tc_digital_model(), and raise MAX to its
+  // largest constant.  The range of the clocks of the digital model
+  // comes from these constants, so they must be integer literals.
+  void check_digital(const std::string& atom, bool update,
+                     const std::set<std::string>& clocks, long& max)
+  {
+    unsigned count = 0;
+    for_each_clock(atom, clocks, [&](size_t, size_t) { ++count; });
+    if (!count)
+      return;
+    if (!update && count > 1)
+      throw std::runtime_error("the digital semantics does not support "
+                               "constraints between clocks like `"
+                               + atom + "'");
+    size_t op = atom.find_first_of(update ? "=" : "<>=!");
+    size_t end = op;
+    while (end < atom.size() && strchr("<>=!", atom[end]))
+      ++end;
+    std::string lhs = trim(atom.substr(0, op));
+    std::string rhs = op == std::string::npos ? "" : trim(atom.substr(end));
+    bool ok;
+    if (update)
+      ok = is_clock(lhs, clocks)
+        && (is_literal(rhs) || is_clock(rhs, clocks));
+    else
+      ok = (is_clock(lhs, clocks) && is_literal(rhs))
+        || (is_literal(lhs) && is_clock(rhs, clocks));
+    if (!ok)
+      throw std::runtime_error("the digital semantics requires clocks to "
+                               "be compared to or set to integer "
+                               "literals, unlike `" + atom + "'");
+    for (size_t i = 0, n = update ? 0 : atom.size(); i < n; ++i)
+      if ((atom[i] == '<' || atom[i] == '>')
+          && (i + 1 == n || atom[i + 1] != '='))
+        throw std::runtime_error("the digital semantics requires a closed "
+                                 "model, but `" + atom + "' is strict");
+    for (size_t i = 0, n = atom.size(); i < n; ++i)
+      if (isdigit(static_cast<unsigned char>(atom[i]))
+          && (i == 0 || !is_ident_char(atom[i - 1])))
+        {
+          size_t j = i;
+          while (j < n && isdigit(static_cast<unsigned char>(atom[j])))
+            ++j;
+          max = std::max(max, std::stol(atom.substr(i, j - i)));
+          i = j;
+        }
+  }
+}
+
+std::string tc_digital_model(const tc_declarations& decls)
+{
+  // Clocks, with their sizes.
+  std::vector<std::pair<std::string, long>> clock_decls;
+  std::set<std::string> clocks;
+  for (auto& d: decls)
+    if (d.kind() == "clock" && d.fields.size() > 2)
+      {
+        clock_decls.emplace_back(d.fields[2], std::stol(d.fields[1]));
+        clocks.insert(d.fields[2]);
+      }
+
+  long max = 0;
+  for (auto& d: decls)
+    for (auto& [key, value]: d.attributes)
+      if (key == "invariant" || key == "provided")
+        for (auto& atom: split(value, '&'))
+          check_digital(atom, false, clocks, max);
+      else if (key == "do")
+        for (auto& stmt: split(value, ';'))
+          check_digital(stmt, true, clocks, max);
+
+  std::ostringstream out;
+  std::vector<std::string> procs;
+  for (auto& d: decls)
+    {
+      // A clock becomes an integer variable ranging over 0..max+1,
+      // where max+1 stands for all values above max.
+      if (d.kind() == "clock" && d.fields.size() > 2)
+        {
+          out << "int:" << d.fields[1] << ":0:" << max + 1 << ":0:"
+              << d.fields[2] << '\n';
+          continue;
+        }
+      if (d.kind() == "process" && d.fields.size() > 1)
+        procs.push_back(d.fields[1]);
+      const char* sep = "";
+      for (auto& f: d.fields)
+        {
+          out << sep << f;
+          sep = ":";
+        }
+      if (!d.attributes.empty())
+        {
+          sep = "{";
+          for (auto& [key, value]: d.attributes)
+            {
+              out << sep << key << ':' << value;
+              sep = " : ";
+            }
+          out << '}';
+        }
+      else if (d.kind() == "location" || d.kind() == "edge")
+        {
+          out << "{}";
+        }
+      out << '\n';
+    }
+
+  // Time elapses by one unit when all processes take a
+  // tcltl_digital_tick edge together: each process can do so from the
+  // locations whose invariant still holds one unit later, and where
+  // time may elapse.
+  out << "event:tcltl_digital_tick\n"
+      << "event:tcltl_digital_incr\n";
+  for (auto& l: tc_model_info(decls).locations)
+    {
+      if (l.committed || l.urgent)
+        continue;
+      out << "edge:" << l.process << ':' << l.name << ':' << l.name
+          << ":tcltl_digital_tick{";
+      if (!l.invariant.empty())
+        out << "provided: " << shift_clocks(l.invariant, clocks);
+      out << "}\n";
+    }
+  // The process tcltl_digital_time then increments all clocks, one
+  // at a time, through committed locations, stopping at max+1.
+  std::vector<std::string> elems;
+  for (auto& [name, size]: clock_decls)
+    if (size == 1)
+      elems.push_back(name);
+    else
+      for (long i = 0; i < size; ++i)
+        elems.push_back(name + '[' + std::to_string(i) + ']');
+  out << "process:tcltl_digital_time\n"
+      << "location:tcltl_digital_time:t{initial:}\n";
+  for (unsigned i = 1; i <= elems.size(); ++i)
+    out << "location:tcltl_digital_time:i" << i << "{committed:}\n";
+  auto loc = [&](unsigned i)
+    {
+      return (i == 0 || i > elems.size()) ? std::string("t")
+        : 'i' + std::to_string(i);
+    };
+  out << "edge:tcltl_digital_time:t:" << loc(1)
+      << ":tcltl_digital_tick{}\n";
+  for (unsigned i = 1; i <= elems.size(); ++i)
+    {
+      const std::string& x = elems[i - 1];
+      out << "edge:tcltl_digital_time:" << loc(i) << ':' << loc(i + 1)
+          << ":tcltl_digital_incr{provided: " << x << "<=" << max
+          << " : do: " << x << '=' << x << "+1}\n"
+          << "edge:tcltl_digital_time:" << loc(i) << ':' << loc(i + 1)
+          << ":tcltl_digital_incr{provided: " << x << ">" << max << "}\n";
+    }
+  out << "sync";
+  for (auto& p: procs)
+    out << ':' << p << "@tcltl_digital_tick";
+  out << ":tcltl_digital_time@tcltl_digital_tick\n";
+  return out.str();
+}
+
+tc_liveness tc_live_variables(const tc_model_info& info, bool clocks)
+{
+  tc_liveness res;
+  for (auto& l: info.locations)
+    res[{l.process, l.name}] = clocks ? l.clocks : l.reads;
+  // Iterate until a fixed point is reached:
+  //   live(src) includes reads(e) and live(tgt) - writes(e),
+  // where writes(e) excludes the variables that e also reads.
+  bool changed = true;
+  while (changed)
+    {
+      changed = false;
+      for (auto& e: info.edges)
+        {
+          auto& reads = clocks ? e.clock_guards : e.reads;
+          auto& writes = clocks ? e.clock_resets : e.writes;
+          auto& live = res[{e.process, e.src}];
+          size_t before = live.size();
+          live.insert(reads.begin(), reads.end());
+          for (auto& v: res[{e.process, e.tgt}])
+            if (!writes.count(v))
+              live.insert(v);
+          changed |= live.size() != before;
+        }
+    }
+  return res;
+}
+
+namespace
+{
+  typedef std::map<std::string, std::string> renaming_t;
+
+  // Split NAME into a non-empty stem and a non-empty numeric suffix.
+  bool split_index(const std::string& name,
+                   std::string& stem, std::string& index)
+  {
+    size_t i = name.size();
+    while (i > 0 && isdigit(static_cast<unsigned char>(name[i - 1])))
+      --i;
+    if (i == 0 || i == name.size())
+      return false;
+    stem = name.substr(0, i);
+    index = name.substr(i);
+    return true;
+  }
+
+  // Apply REN to all identifiers in S.
+  std::string rename(const std::string& s, const renaming_t& ren)
+  {
+    if (ren.empty())
+      return s;
+    std::string res;
+    size_t i = 0;
+    size_t n = s.size();
+    while (i < n)
+      {
+        if (!is_ident_char(s[i]))
+          {
+            res += s[i++];
+            continue;
+          }
+        size_t j = i;
+        while (j < n && is_ident_char(s[j]))
+          ++j;
+        std::string id = s.substr(i, j - i);
+        auto it = ren.find(id);
+        res += it == ren.end() ? id : it->second;
+        i = j;
+      }
+    return res;
+  }
+
+  // A textual representation of D after renaming, where the order of
+  // the processes in a sync declaration does not matter.
+  std::string normalize(const tc_declaration& d, const renaming_t& ren)
+  {
+    std::vector<std::string> fields;
+    for (auto& f: d.fields)
+      fields.push_back(rename(f, ren));
+    if (d.kind() == "sync")
+      std::sort(fields.begin() + 1, fields.end());
+    std::string res;
+    for (auto& f: fields)
+      {
+        if (!res.empty())
+          res += ':';
+        res += f;
+      }
+    if (!d.attributes.empty())
+      {
+        res += '{';
+        for (auto& [k, v]: d.attributes)
+          res += k + ':' + rename(v, ren) + ':';
+        res += '}';
+      }
+    return res;
+  }
+
+  class symmetry_finder
+  {
+    const tc_declarations& decls_;
+    // Kind of each global identifier.
+    std::map<std::string, std::string> globals_;
+    // Sorted normalized declarations.
+    std::vector<std::string> reference_;
+  public:
+    symmetry_finder(const tc_declarations& decls)
+      : decls_(decls)
+    {
+      for (auto& d: decls)
+        {
+          const std::string& k = d.kind();
+          if ((k == "process" || k == "event") && d.fields.size() > 1)
+            globals_[d.fields[1]] = k;
+          else if (k == "clock" && d.fields.size() > 2)
+            globals_[d.fields[2]] = k;
+          else if (k == "int" && d.fields.size() > 5)
+            globals_[d.fields[5]] = k;
+        }
+      reference_ = normalized({});
+    }
+
+    std::vector<std::string> normalized(const renaming_t& ren) const
+    {
+      std::vector<std::string> res;
+      res.reserve(decls_.size());
+      for (auto& d: decls_)
+        res.push_back(normalize(d, ren));
+      std::sort(res.begin(), res.end());
+      return res;
+    }
+
+    // The renaming that swaps processes PA and PB, whose indices are
+    // A and B, as well as all the clocks, variables, and events that
+    // exist with both indices.
+    renaming_t swap(const std::string& pa, const std::string& a,
+                    const std::string& pb, const std::string& b) const
+    {
+      renaming_t res;
+      res[pa] = pb;
+      res[pb] = pa;
+      std::string stem;
+      std::string index;
+      for (auto& [name, kind]: globals_)
+        if (kind != "process" && split_index(name, stem, index)
+            && index == a)
+          {
+            auto it = globals_.find(stem + b);
+            if (it != globals_.end() && it->second == kind)
+              {
+                res[name] = stem + b;
+                res[stem + b] = name;
+              }
+          }
+      return res;
+    }
+
+    bool is_automorphism(const renaming_t& ren) const
+    {
+      return normalized(ren) == reference_;
+    }
+
+    // The part of the swap from PA (of index A) to another process
+    // that concerns PA and its clocks and variables.
+    renaming_t owned(const renaming_t& swap, const std::string& pa,
+                     const std::string& a) const
+    {
+      renaming_t res;
+      std::string stem;
+      std::string index;
+      for (auto& [from, to]: swap)
+        if (from == pa
+            || (split_index(from, stem, index) && index == a
+                && globals_.at(from) != "event"
+                && globals_.at(from) != "process"))
+          res[from] = to;
+      return res;
+    }
+
+    tc_symmetry_groups run() const
+    {
+      // Candidate processes, grouped by stem, in declaration order.
+      std::map<std::string,
+               std::vector<std::pair<std::string, std::string>>> cands;
+      for (auto& d: decls_)
+        if (d.kind() == "process" && d.fields.size() > 1)
+          {
+            std::string stem;
+            std::string index;
+            if (split_index(d.fields[1], stem, index))
+              cands[stem].emplace_back(d.fields[1], index);
+          }
+
+      tc_symmetry_groups res;
+      for (auto& [stem, procs]: cands)
+        {
+          auto remaining = procs;
+          while (remaining.size() >= 2)
+            {
+              auto& [first, idx0] = remaining.front();
+              tc_symmetry_group g;
+              g.processes.push_back(first);
+              g.renaming.emplace_back();
+              std::vector<std::pair<std::string, std::string>> rest;
+              for (size_t i = 1; i < remaining.size(); ++i)
+                {
+                  renaming_t s = swap(first, idx0, remaining[i].first,
+                                      remaining[i].second);
+                  renaming_t o = owned(s, first, idx0);
+                  // All members must own the same identifiers.
+                  bool same_keys = g.renaming.size() == 1
+                    || (o.size() == g.renaming[1].size()
+                        && std::equal(o.begin(), o.end(),
+                                      g.renaming[1].begin(),
+                                      [](auto& x, auto& y)
+                                      {
+                                        return x.first == y.first;
+                                      }));
+                  if (same_keys && is_automorphism(s))
+                    {
+                      g.processes.push_back(remaining[i].first);
+                      g.renaming.push_back(std::move(o));
+                    }
+                  else
+                    {
+                      rest.push_back(remaining[i]);
+                    }
+                }
+              if (g.processes.size() >= 2)
+                {
+                  for (auto& [from, to]: g.renaming[1])
+                    g.renaming[0][from] = from;
+                  res.push_back(std::move(g));
+                }
+              remaining = std::move(rest);
+            }
+        }
+      return res;
+    }
+  };
+}
+
+tc_symmetry_groups tc_find_symmetries(const tc_declarations& decls)
+{
+  return symmetry_finder(decls).run();
+}
+
@@ -0,0 +1,181 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2019 Laboratoire de Recherche et Développement
+// de l'Epita (LRDE).
+//
+// This file is part of TCLTL, a model checker for timed-automata.
+//
+// TCLTL is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// TCLTL is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+// License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+// Information extracted from the text of a TChecker model.
+//
+// TChecker's model_t gives us the instantiated system, but it does
+// not keep some of the structure of the declarations that the
+// reductions implemented in tcltl.cc need, for instance which
+// processes are copies of each other.  TChecker's declarations are
+// simple enough to be parsed again here.  This header is internal
+// to the library.
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// One declaration of the model, such as
+//   edge:P:l:m:a{provided: x>=1 : do: x=0}
+// is stored as fields {"edge", "P", "l", "m", "a"} and attributes
+// {{"provided", "x>=1"}, {"do", "x=0"}}, with blanks trimmed.
+struct tc_declaration
+{
+  std::vector<std::string> fields;
+  std::vector<std::pair<std::string, std::string>> attributes;
+
+  const std::string& kind() const
+  {
+    return fields.front();
+  }
+
+  // Return the value of attribute KEY, or an empty string.
+  std::string attribute(const std::string& key) const;
+};
+typedef std::vector<tc_declaration> tc_declarations;
+
+// Parse the declarations in TEXT.  This assumes that TChecker has
+// already accepted TEXT, so there is no error reporting: anything
+// that cannot be parsed is ignored.
+tc_declarations tc_parse_declarations(const std::string& text);
+
+// The part of the model that concerns one edge.  All names are
+// those of the declarations.
+struct tc_edge_info
+{
+  std::string process;
+  std::string src;
+  std::string tgt;
+  std::string event;
+  // Integer variables read (in the guard, or in the right-hand side
+  // or array indices of the updates) and written by the edge.  An
+  // array of which only one element is assigned is both read and
+  // written.
+  std::set<std::string> reads;
+  std::set<std::string> writes;
+  // Clocks tested by the guard, and clocks assigned by the updates.
+  // As for integer variables, a clock array of which only one
+  // element is reset also counts as tested.
+  std::set<std::string> clock_guards;
+  std::set<std::string> clock_resets;
+  // Whether the edge appears in a sync declaration.
+  bool synchronized = false;
+};
+
+// The part of the model that concerns one location.
+struct tc_location_info
+{
+  std::string process;
+  std::string name;
+  // The invariant, as written in the model.
+  std::string invariant;
+  // Integer variables and clocks appearing in the invariant.
+  std::set<std::string> reads;
+  std::set<std::string> clocks;
+  bool initial = false;
+  bool committed = false;
+  bool urgent = false;
+};
+
+// A digest of the declarations of a model.
+struct tc_model_info
+{
+  std::vector<std::string> processes;
+  std::set<std::string> clocks;
+  std::set<std::string> intvars;
+  std::vector<tc_location_info> locations;
+  std::vector<tc_edge_info> edges;
+
+  tc_model_info(const tc_declarations& decls);
+};
+
+// The variables that are live at each location of each process,
+// indexed by (process name, location name).
+typedef std::pair<std::string, std::string> tc_location_name;
+typedef std::map<tc_location_name, std::set<std::string>> tc_liveness;
+
+// Compute, for each location of each process, the integer variables
+// (or the clocks, if CLOCKS is set) that the process may read before
+// writing (or resetting) them, from that location on.  Reads are
+// those of the invariants, guards and updates.  An edge that both
+// reads and writes a variable is assumed to read it first.
+//
+// A variable that is not live at the current location of any
+// process will be written before being read again, so its value does
+// not matter.
+tc_liveness tc_live_variables(const tc_model_info& info,
+                              bool clocks = false);
+
+// Return the text of a model obtained from DECLS by removing all
+// clocks except those in KEEP: their declarations, the conjuncts of
+// guards and invariants that mention them, and their resets.  The
+// resulting model has all the runs of the original model (up to the
+// removed clocks), and possibly more.  If STUTTER is set, an extra
+// process "tcltl_untimed_stutter" that can always loop on its only
+// location is added, so that every state can stutter (as states that
+// are dead in the original model would do).
+std::string tc_untimed_model(const tc_declarations& decls, bool stutter,
+                             const std::set<std::string>& keep = {});
+
+// Return the text of a model obtained from DECLS by giving integer
+// values to its clocks (the digital-clock semantics, which is exact
+// for closed timed automata as far as the integer instants are
+// concerned).  Each clock becomes an integer variable ranging over
+// 0..M+1, where M is the largest constant compared to or assigned to
+// a clock, and M+1 stands for all larger values.  Time elapses one
+// unit at a time through an event "tcltl_digital_tick" on which all
+// processes synchronize, from locations that are neither committed
+// nor urgent, and whose invariant still holds one unit later.  A
+// process "tcltl_digital_time" then increments the clocks through
+// committed locations.  This throws std::runtime_error on strict
+// clock constraints, on constraints between two clocks, and when a
+// clock is compared to or set to anything but an integer literal or
+// (for updates) another clock.
+std::string tc_digital_model(const tc_declarations& decls);
+
+// A group of processes that can be permuted arbitrarily without
+// changing the behavior of the system, as found by
+// tc_find_symmetries().
+//
+// renaming[k] maps the names of the processes, clocks and integer
+// variables that belong to processes[0] to the corresponding names
+// for processes[k].  (renaming[0] is the identity on the same keys.)
+struct tc_symmetry_group
+{
+  std::vector<std::string> processes;
+  std::vector<std::map<std::string, std::string>> renaming;
+};
+typedef std::vector<tc_symmetry_group> tc_symmetry_groups;
+
+// Find groups of symmetric processes.
+//
+// Processes are candidates if their names differ only by a numeric
+// suffix, like P1, P2, P3.  The clocks, integer variables and events
+// sharing that suffix (x1, x2, x3) are assumed to belong to the
+// corresponding process.  Two processes are interchangeable if
+// swapping their suffixes in all identifiers maps the set of
+// declarations of the model onto itself (up to the order of
+// declarations, and of the processes in sync declarations).  A
+// group contains processes that are all interchangeable with its
+// first member, so all permutations of the group preserve the
+// system.
+tc_symmetry_groups tc_find_symmetries(const tc_declarations& decls);
@@ -0,0 +1,685 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2019 Laboratoire de Recherche et Développement
+// de l'Epita (LRDE).
+//
+// This file is part of TCLTL, a model checker for timed-automata.
+//
+// TCLTL is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// TCLTL is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+// License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "config.h"
+#include <algorithm>
+#include <climits>
+#include <deque>
+#include <queue>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <spot/misc/hashfunc.hh>
+#include <spot/twa/twagraph.hh>
+#include <spot/twaalgos/sccinfo.hh>
+#include <spot/twaalgos/strength.hh>
+
+#include "tcltl.hh"
+
+namespace
+{
+  // A state of the product: a state of the Kripke structure, and the
+  // number of a state of the automaton.  If MEM is not null, the
+  // state is counted there.
+  class lazy_product_state final: public spot::state
+  {
+  public:
+    lazy_product_state(const spot::state* k, unsigned q,
+                       tc_memory_stats* mem)
+      : k_(k), q_(q), mem_(mem)
+    {
+      if (mem_)
+        mem_->allocate(sizeof(*this));
+    }
+
+    lazy_product_state* clone() const override
+    {
+      return new lazy_product_state(k_->clone(), q_, mem_);
+    }
+
+    size_t hash() const override
+    {
+      return k_->hash() ^ spot::wang32_hash(q_);
+    }
+
+    int compare(const spot::state* other) const override
+    {
+      auto o = spot::down_cast<const lazy_product_state*>(other);
+      if (q_ != o->q_)
+        return q_ < o->q_ ? -1 : 1;
+      return k_->compare(o->k_);
+    }
+
+    const spot::state* kripke_state() const
+    {
+      return k_;
+    }
+
+    unsigned aut_state() const
+    {
+      return q_;
+    }
+
+  private:
+    ~lazy_product_state()
+    {
+      k_->destroy();
+      if (mem_)
+        mem_->deallocate(sizeof(*this));
+    }
+
+    const spot::state* k_;
+    unsigned q_;
+    tc_memory_stats* mem_;
+  };
+
+  // Iterate over the pairs made of a successor of the Kripke state
+  // and a transition of the automaton that is compatible with the
+  // label of the Kripke state.  Since that label is the same for
+  // all the successors of a Kripke state, the compatible
+  // transitions of the automaton are selected once.
+  class lazy_product_iterator final: public spot::twa_succ_iterator
+  {
+  public:
+    lazy_product_iterator(const spot::const_kripke_ptr& k,
+                          spot::twa_succ_iterator* kit,
+                          const spot::const_twa_graph_ptr& aut,
+                          unsigned q, tc_memory_stats* mem)
+      : k_(k), kit_(kit), aut_(aut), shift_(aut->num_sets()), mem_(mem)
+    {
+      bdd label = kit->cond();
+      for (auto& e: aut->out(q))
+        if (bdd c = e.cond & label; c != bddfalse)
+          edges_.push_back({e.dst, c, e.acc});
+    }
+
+    ~lazy_product_iterator()
+    {
+      k_->release_iter(kit_);
+    }
+
+    bool first() override
+    {
+      pos_ = 0;
+      return !edges_.empty() && kit_->first();
+    }
+
+    bool next() override
+    {
+      if (++pos_ < edges_.size())
+        return true;
+      pos_ = 0;
+      return kit_->next();
+    }
+
+    bool done() const override
+    {
+      return edges_.empty() || kit_->done();
+    }
+
+    const spot::state* dst() const override
+    {
+      return new lazy_product_state(kit_->dst(), edges_[pos_].dst, mem_);
+    }
+
+    bdd cond() const override
+    {
+      return edges_[pos_].cond;
+    }
+
+    spot::acc_cond::mark_t acc() const override
+    {
+      return edges_[pos_].acc | (kit_->acc() << shift_);
+    }
+
+  private:
+    struct edge
+    {
+      unsigned dst;
+      bdd cond;
+      spot::acc_cond::mark_t acc;
+    };
+
+    spot::const_kripke_ptr k_;
+    spot::twa_succ_iterator* kit_;
+    spot::const_twa_graph_ptr aut_;
+    unsigned shift_;
+    tc_memory_stats* mem_;
+    std::vector<edge> edges_;
+    unsigned pos_ = 0;
+  };
+
+  // The product of a Kripke structure with an automaton.  The
+  // acceptance sets of the automaton come first, followed by those of
+  // the Kripke structure.
+  class lazy_product final: public spot::twa
+  {
+  public:
+    lazy_product(const spot::const_kripke_ptr& k,
+                 const spot::const_twa_graph_ptr& aut)
+      : twa(aut->get_dict()), k_(k), aut_(aut),
+        tck_(dynamic_cast<const tc_kripke*>(k.get()))
+    {
+      if (auto* stats = k->get_named_prop<tc_kripke_stats>("tcltl-stats"))
+        mem_ = &stats->product_states;
+      get_dict()->register_all_variables_of(&*k_, this);
+      get_dict()->register_all_variables_of(&*aut_, this);
+      unsigned n = aut->num_sets();
+      set_acceptance(n + k->num_sets(),
+                     aut->get_acceptance() & (k->get_acceptance() << n));
+      // The variables used by the transitions leaving each state
+      // of the automaton.
+      unsigned ns = aut->num_states();
+      support_.reserve(ns);
+      for (unsigned q = 0; q < ns; ++q)
+        {
+          bdd sup = bddtrue;
+          for (auto& e: aut->out(q))
+            sup &= bdd_support(e.cond);
+          support_.push_back(sup);
+        }
+    }
+
+    ~lazy_product()
+    {
+      get_dict()->unregister_all_my_variables(this);
+    }
+
+    const spot::state* get_init_state() const override
+    {
+      return new lazy_product_state(k_->get_init_state(),
+                                    aut_->get_init_state_number(), mem_);
+    }
+
+    spot::twa_succ_iterator* succ_iter(const spot::state* s) const override
+    {
+      auto ps = spot::down_cast<const lazy_product_state*>(s);
+      const spot::state* ks = ps->kripke_state();
+      unsigned q = ps->aut_state();
+      spot::twa_succ_iterator* kit = tck_
+        ? tck_->succ_iter(ks, support_[q]) : k_->succ_iter(ks);
+      return new lazy_product_iterator(k_, kit, aut_, q, mem_);
+    }
+
+    std::string format_state(const spot::state* s) const override
+    {
+      auto ps = spot::down_cast<const lazy_product_state*>(s);
+      return k_->format_state(ps->kripke_state()) + " * "
+        + aut_->format_state(aut_->state_from_number(ps->aut_state()));
+    }
+
+    spot::state* project_state(const spot::state* s,
+                               const spot::const_twa_ptr& t) const override
+    {
+      auto ps = spot::down_cast<const lazy_product_state*>(s);
+      if (t.get() == k_.get())
+        return ps->kripke_state()->clone();
+      if (t.get() == aut_.get())
+        return aut_->state_from_number(ps->aut_state())->clone();
+      return nullptr;
+    }
+
+  private:
+    spot::const_kripke_ptr k_;
+    spot::const_twa_graph_ptr aut_;
+    const tc_kripke* tck_;
+    std::vector<bdd> support_;
+    // Where product states are counted, if K has statistics.
+    tc_memory_stats* mem_ = nullptr;
+  };
+
+  // An explicit copy of the reachable part of an automaton.  Edge
+  // numbers index EDGES, and OUT and IN give the numbers of the edges
+  // leaving and entering each state.
+  struct explicit_copy
+  {
+    struct edge
+    {
+      unsigned src;
+      unsigned dst;
+      bdd cond;
+      spot::acc_cond::mark_t acc;
+    };
+
+    std::vector<const spot::state*> states;
+    std::vector<edge> edges;
+    std::vector<std::vector<unsigned>> out;
+    std::vector<std::vector<unsigned>> in;
+
+    explicit_copy(const spot::const_twa_ptr& a)
+    {
+      spot::state_map<unsigned> seen;
+      auto number = [&](const spot::state* s)
+        {
+          auto [p, inserted] = seen.emplace(s, states.size());
+          if (inserted)
+            {
+              states.push_back(s);
+              out.emplace_back();
+              in.emplace_back();
+            }
+          else
+            {
+              s->destroy();
+            }
+          return p->second;
+        };
+      number(a->get_init_state());
+      for (unsigned src = 0; src < states.size(); ++src)
+        {
+          spot::twa_succ_iterator* it = a->succ_iter(states[src]);
+          for (it->first(); !it->done(); it->next())
+            {
+              unsigned dst = number(it->dst());
+              unsigned e = edges.size();
+              edges.push_back({src, dst, it->cond(), it->acc()});
+              out[src].push_back(e);
+              in[dst].push_back(e);
+            }
+          a->release_iter(it);
+        }
+    }
+
+    ~explicit_copy()
+    {
+      for (auto* s: states)
+        s->destroy();
+    }
+
+    explicit_copy(const explicit_copy&) = delete;
+    explicit_copy& operator=(const explicit_copy&) = delete;
+
+    // Breadth-first search from FROM, following the edges forward
+    // (or backward if BACKWARD is set), among the states for which
+    // KEEP is true.  Set DIST to the distance of each state (UINT_MAX
+    // if unreached), and VIA to the edge used to reach it.
+    template<class Keep>
+    void bfs(unsigned from, bool backward, Keep keep,
+             std::vector<unsigned>& dist, std::vector<unsigned>& via) const
+    {
+      dist.assign(states.size(), UINT_MAX);
+      via.assign(states.size(), UINT_MAX);
+      std::deque<unsigned> todo{from};
+      dist[from] = 0;
+      while (!todo.empty())
+        {
+          unsigned s = todo.front();
+          todo.pop_front();
+          for (unsigned e: (backward ? in : out)[s])
+            {
+              unsigned t = backward ? edges[e].src : edges[e].dst;
+              if (dist[t] != UINT_MAX || !keep(t))
+                continue;
+              dist[t] = dist[s] + 1;
+              via[t] = e;
+              todo.push_back(t);
+            }
+        }
+    }
+  };
+
+  void relabel(const spot::const_kripke_ptr& k, spot::twa_run::steps& steps)
+  {
+    for (auto& step: steps)
+      {
+        spot::twa_succ_iterator* it = k->succ_iter(step.s);
+        step.label = it->cond();
+        k->release_iter(it);
+      }
+  }
+
+  // Turn a run of the product into a run of K.
+  spot::twa_run_ptr project_run(const spot::twa_run_ptr& run,
+                                const spot::const_kripke_ptr& k)
+  {
+    spot::twa_run_ptr res = run->project(k);
+    relabel(k, res->prefix);
+    relabel(k, res->cycle);
+    return res;
+  }
+
+  // Once the product has reached an accepting SCC of a terminal
+  // automaton, any infinite path is accepted.  Follow the first
+  // successor of each state from S until a state repeats, and add the
+  // resulting lasso to RUN.  S is not consumed.  Return false if a
+  // state without successor is reached.
+  bool add_lasso(const spot::const_twa_ptr& prod, const spot::state* s,
+                 spot::twa_run& run)
+  {
+    std::vector<spot::twa_run::step> path;
+    spot::state_map<unsigned> index;
+    const spot::state* cur = s->clone();
+    unsigned loop;
+    for (;;)
+      {
+        if (auto [it, inserted] = index.emplace(cur, path.size());
+            !inserted)
+          {
+            loop = it->second;
+            cur->destroy();
+            break;
+          }
+        spot::twa_succ_iterator* it = prod->succ_iter(cur);
+        if (!it->first())
+          {
+            prod->release_iter(it);
+            for (auto& step: path)
+              step.s->destroy();
+            cur->destroy();
+            return false;
+          }
+        path.emplace_back(cur, it->cond(), it->acc());
+        cur = it->dst();
+        prod->release_iter(it);
+      }
+    for (unsigned i = 0, n = path.size(); i < n; ++i)
+      (i < loop ? run.prefix : run.cycle).push_back(path[i]);
+    return true;
+  }
+}
+
+spot::twa_run_ptr
+lazy_intersecting_run(const spot::const_kripke_ptr& k,
+                      const spot::const_twa_graph_ptr& aut)
+{
+  auto prod = std::make_shared<lazy_product>(k, aut);
+  spot::twa_run_ptr run = prod->accepting_run();
+  if (!run)
+    return nullptr;
+  return project_run(run, k);
+}
+
+spot::twa_run_ptr
+guided_intersecting_run(const spot::const_kripke_ptr& k,
+                        const spot::const_twa_graph_ptr& aut)
+{
+  auto tck = dynamic_cast<const tc_kripke*>(k.get());
+  spot::scc_info si(aut);
+  if (!tck || k->num_sets() || !spot::is_terminal_automaton(aut, &si))
+    return lazy_intersecting_run(k, aut);
+
+  // The heuristic looks at the propositions used by the transitions
+  // that leave the SCC of the current state of the automaton, since
+  // these are those that make progress toward acceptance.
+  unsigned ns = aut->num_states();
+  std::vector<bdd> progress(ns, bddtrue);
+  for (unsigned q = 0; q < ns; ++q)
+    for (auto& e: aut->out(q))
+      if (si.scc_of(e.dst) != si.scc_of(q))
+        progress[q] &= bdd_support(e.cond);
+
+  auto prod = std::make_shared<lazy_product>(k, aut);
+  // For each state seen, its predecessor in the search and the
+  // transition from it.
+  struct origin
+  {
+    const spot::state* pred;
+    bdd cond;
+    spot::acc_cond::mark_t acc;
+  };
+  spot::state_map<origin> seen;
+  // States to explore, by increasing distance, then in the order in
+  // which they were found.
+  typedef std::tuple<unsigned, size_t, const spot::state*> entry;
+  std::priority_queue<entry, std::vector<entry>, std::greater<entry>> todo;
+  size_t order = 0;
+  auto push = [&](const spot::state* s)
+    {
+      auto ps = spot::down_cast<const lazy_product_state*>(s);
+      unsigned h = tck->distance(ps->kripke_state(),
+                                 progress[ps->aut_state()]);
+      todo.emplace(h, order++, s);
+    };
+
+  const spot::state* init = prod->get_init_state();
+  seen.emplace(init, origin{nullptr, bddfalse, {}});
+  push(init);
+  const spot::state* target = nullptr;
+  while (!todo.empty())
+    {
+      const spot::state* s = std::get<2>(todo.top());
+      todo.pop();
+      unsigned q = spot::down_cast<const lazy_product_state*>(s)->aut_state();
+      if (si.is_accepting_scc(si.scc_of(q)))
+        {
+          target = s;
+          break;
+        }
+      spot::twa_succ_iterator* it = prod->succ_iter(s);
+      for (it->first(); !it->done(); it->next())
+        {
+          const spot::state* d = it->dst();
+          if (seen.emplace(d, origin{s, it->cond(), it->acc()}).second)
+            push(d);
+          else
+            d->destroy();
+        }
+      prod->release_iter(it);
+    }
+
+  spot::twa_run_ptr run = nullptr;
+  bool fallback = false;
+  if (target)
+    {
+      run = std::make_shared<spot::twa_run>(prod);
+      for (const spot::state* s = target;;)
+        {
+          const origin& o = seen[s];
+          if (!o.pred)
+            break;
+          run->prefix.emplace_front(o.pred->clone(), o.cond, o.acc);
+          s = o.pred;
+        }
+      fallback = !add_lasso(prod, target, *run);
+    }
+  for (auto& p: seen)
+    p.first->destroy();
+  // A state without successor was reached, so the lasso has to be
+  // found elsewhere.
+  if (fallback)
+    return lazy_intersecting_run(k, aut);
+  if (!run)
+    return nullptr;
+  return project_run(run, k);
+}
+
+spot::twa_run_ptr
+bounded_intersecting_run(const spot::const_kripke_ptr& k,
+                         const spot::const_twa_graph_ptr& aut,
+                         unsigned depth, bool* complete)
+{
+  auto prod = std::make_shared<lazy_product>(k, aut);
+  // The part of the product explored so far, where state N of G
+  // stands for states[N].  It grows by one level of the breadth-first
+  // search at a time, so each depth reuses the exploration of the
+  // previous ones.
+  auto g = spot::make_twa_graph(aut->get_dict());
+  g->copy_ap_of(aut);
+  g->copy_ap_of(k);
+  g->set_acceptance(prod->num_sets(), prod->get_acceptance());
+  std::vector<const spot::state*> states;
+  spot::state_map<unsigned> seen;
+
+  const spot::state* init = prod->get_init_state();
+  seen.emplace(init, 0);
+  states.push_back(init);
+  g->set_init_state(g->new_state());
+  std::vector<unsigned> frontier{0};
+  spot::twa_run_ptr run = nullptr;
+  // Whether some successor was ignored because of the bound.
+  bool truncated = false;
+  for (unsigned d = 0; d <= depth && !frontier.empty() && !run; ++d)
+    {
+      std::vector<unsigned> next;
+      // Only the edges that reach a state seen before can close a
+      // new cycle.
+      bool closed = false;
+      for (unsigned src: frontier)
+        {
+          spot::twa_succ_iterator* it = prod->succ_iter(states[src]);
+          for (it->first(); !it->done(); it->next())
+            {
+              const spot::state* dst = it->dst();
+              unsigned n;
+              if (auto p = seen.find(dst); p != seen.end())
+                {
+                  dst->destroy();
+                  n = p->second;
+                  closed = true;
+                }
+              else if (d < depth)
+                {
+                  n = states.size();
+                  seen.emplace(dst, n);
+                  states.push_back(dst);
+                  g->new_state();
+                  next.push_back(n);
+                }
+              else
+                {
+                  dst->destroy();
+                  truncated = true;
+                  continue;
+                }
+              g->new_edge(src, n, it->cond(), it->acc());
+            }
+          prod->release_iter(it);
+        }
+      frontier.swap(next);
+      if (!closed)
+        continue;
+      if (spot::twa_run_ptr grun = g->accepting_run())
+        {
+          run = std::make_shared<spot::twa_run>(prod);
+          auto convert = [&](const spot::twa_run::steps& from,
+                             spot::twa_run::steps& to)
+            {
+              for (auto& step: from)
+                to.emplace_back(states[g->state_number(step.s)]->clone(),
+                                step.label, step.acc);
+            };
+          convert(grun->prefix, run->prefix);
+          convert(grun->cycle, run->cycle);
+        }
+    }
+  if (complete)
+    *complete = !run && !truncated;
+  for (auto* s: states)
+    s->destroy();
+  if (!run)
+    return nullptr;
+  return project_run(run, k);
+}
+
+spot::twa_run_ptr
+shortest_accepting_run(const spot::const_twa_ptr& a)
+{
+  explicit_copy p(a);
+  unsigned ns = p.states.size();
+  auto g = spot::make_twa_graph(a->get_dict());
+  g->copy_ap_of(a);
+  g->set_acceptance(a->num_sets(), a->get_acceptance());
+  g->new_states(ns);
+  g->set_init_state(0);
+  for (auto& e: p.edges)
+    g->new_edge(e.src, e.dst, e.cond, e.acc);
+  spot::scc_info si(g);
+
+  // The prefix leads to the closest state of an accepting SCC.
+  std::vector<unsigned> dist;
+  std::vector<unsigned> via;
+  p.bfs(0, false, [](unsigned) { return true; }, dist, via);
+  unsigned s = UINT_MAX;
+  for (unsigned t = 0; t < ns; ++t)
+    if (dist[t] != UINT_MAX && si.is_accepting_scc(si.scc_of(t))
+        && (s == UINT_MAX || dist[t] < dist[s]))
+      s = t;
+  if (s == UINT_MAX)
+    return nullptr;
+  std::vector<unsigned> prefix;
+  for (unsigned t = s; t != 0; t = p.edges[via[t]].src)
+    prefix.push_back(via[t]);
+  std::reverse(prefix.begin(), prefix.end());
+
+  // The cycle goes from S to the edge that adds acceptance sets at
+  // the smallest cost (distance to it, plus distance from it back to
+  // S), until the sets seen are accepting, and then back to S.  With
+  // at most one acceptance set, this is a shortest accepting cycle
+  // through S.
+  unsigned scc = si.scc_of(s);
+  auto in_scc = [&](unsigned t) { return si.scc_of(t) == scc; };
+  std::vector<unsigned> back;
+  std::vector<unsigned> back_via;
+  p.bfs(s, true, in_scc, back, back_via);
+  std::vector<unsigned> cycle;
+  spot::acc_cond::mark_t seen = {};
+  unsigned cur = s;
+  while (cycle.empty() || !g->acc().accepting(seen))
+    {
+      bool any = g->acc().accepting(seen);
+      p.bfs(cur, false, in_scc, dist, via);
+      unsigned best = UINT_MAX;
+      unsigned best_cost = UINT_MAX;
+      for (unsigned t: si.states_of(scc))
+        if (dist[t] != UINT_MAX)
+          for (unsigned e: p.out[t])
+            {
+              auto& edge = p.edges[e];
+              if (!in_scc(edge.dst) || (!any && edge.acc.subset(seen)))
+                continue;
+              if (unsigned c = dist[t] + 1 + back[edge.dst]; c < best_cost)
+                {
+                  best = e;
+                  best_cost = c;
+                }
+            }
+      std::vector<unsigned> path{best};
+      for (unsigned t = p.edges[best].src; t != cur; t = p.edges[via[t]].src)
+        path.push_back(via[t]);
+      for (auto i = path.rbegin(); i != path.rend(); ++i)
+        {
+          cycle.push_back(*i);
+          seen |= p.edges[*i].acc;
+        }
+      cur = p.edges[best].dst;
+    }
+  for (unsigned t = cur; t != s; t = p.edges[back_via[t]].dst)
+    cycle.push_back(back_via[t]);
+
+  auto run = std::make_shared<spot::twa_run>(a);
+  for (unsigned e: prefix)
+    run->prefix.emplace_back(p.states[p.edges[e].src]->clone(),
+                             p.edges[e].cond, p.edges[e].acc);
+  for (unsigned e: cycle)
+    run->cycle.emplace_back(p.states[p.edges[e].src]->clone(),
+                            p.edges[e].cond, p.edges[e].acc);
+  return run;
+}
+
+spot::twa_run_ptr
+shortest_intersecting_run(const spot::const_kripke_ptr& k,
+                          const spot::const_twa_graph_ptr& aut)
+{
+  spot::twa_run_ptr run =
+    shortest_accepting_run(std::make_shared<lazy_product>(k, aut));
+  if (!run)
+    return nullptr;
+  return project_run(run, k);
+}
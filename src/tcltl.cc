@@ -21,19 +21,42 @@
 // A lot of code in this file is inspired from Spot's interface
 // with LTSmin, as seen in Spot's spot/ltsmin/ltsmin.cc file.
 
+#include "config.h"
 #include <iostream>
 #include <sstream>
 #include <cassert>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
+#if HAVE_MEMFD_CREATE
+#  include <sys/mman.h>
+#endif
 
 #include <tchecker/parsing/parsing.hh>
 #include <tchecker/utils/log.hh>
 #include <tchecker/zg/zg_ta.hh>
 #include <tchecker/ts/allocators.hh>
 #include <tchecker/ts/builder.hh>
+#include <tchecker/dbm/db.hh>
 
 #include <spot/misc/fixpool.hh>
 
 #include "tcltl.hh"
+#include "modelinfo.hh"
 
 
 // prop_list encodes the list of atomic propositions we have to
@@ -71,6 +94,21 @@ public:
   tchecker::log_t log = &os;
   const tchecker::parsing::system_declaration_t* sysdecl;
   tchecker::zg::ta::model_t* model;
+  // The file the model was loaded from, if any, and its status at
+  // that time.
+  std::string filename;
+  struct stat file_stat;
+  // The text of the model.  For a model loaded from a file, it is
+  // only read when get_source() is first called, so that loading a
+  // model costs no more than TChecker's parser.
+  mutable std::string source;
+  mutable std::once_flag source_once;
+  // Diagnostics output while instantiating the model.  They are
+  // given to each tc_model that shares these details.
+  std::string load_logs;
+  // The predecessors of each location (by id) in the graph of its
+  // process, for the heuristic of guided searches.
+  std::vector<std::vector<unsigned>> loc_preds;
 
   std::string get_logs()
   {
@@ -79,6 +117,11 @@ public:
     return res;
   }
 
+  // Return the text of the model, for the analyses of modelinfo.hh.
+  // This throws if the file has changed since the model was loaded,
+  // as its text would no longer be that of the instantiated model.
+  const std::string& get_source() const;
+
   ~tc_model_details()
   {
     delete model;
@@ -91,6 +134,558 @@ public:
   }
 };
 
+// TChecker only gives read access to the components of a state.  The
+// only states we modify are successors that have just been built and
+// are not shared yet, so writing through these references is safe.
+template <typename T>
+static T& writable(const T& x)
+{
+  return const_cast<T&>(x);
+}
+
+// Look NAME up in a TChecker index, returning -1 if it is unknown.
+template <typename INDEX>
+static int lookup(const INDEX& idx, const std::string& name)
+{
+  try
+    {
+      return idx.key(name);
+    }
+  catch (const std::invalid_argument&)
+    {
+      return -1;
+    }
+}
+
+// A group of interchangeable processes, used by
+// tcltl_kripke::canonicalize() for symmetry reduction.  Member m of
+// the group is process procs[m].  Its integer variables and clocks
+// are vars[m] and clocks[m] (the latter as DBM indices), listed in
+// the same order for all members.  Likewise, its locations are
+// locs[m], and loc_rank maps the id of any location of any member
+// to its position in locs[m].
+struct sym_group
+{
+  std::vector<unsigned> procs;
+  std::vector<std::vector<unsigned>> vars;
+  std::vector<std::vector<unsigned>> clocks;
+  std::vector<std::vector<unsigned>> locs;
+  std::vector<unsigned> loc_rank;
+};
+typedef std::vector<sym_group> sym_groups;
+
+// Build the symmetry groups of a model.  Processes that are observed
+// by atomic propositions in PS (directly, or through one of their
+// variables) are left out of the groups, so that permutations
+// preserve the labels of the states.
+static sym_groups make_sym_groups(const tc_model_details& tcmd,
+                                  const prop_list& ps)
+{
+  sym_groups res;
+  const auto& sys = tcmd.model->system();
+  const auto& procidx = sys.processes();
+  const auto& intvars = tcmd.model->system_integer_variables();
+  const auto& clocks = tcmd.model->system_clock_variables();
+
+  std::set<unsigned> obs_procs;
+  std::set<unsigned> obs_vars;
+  for (const one_prop& p: ps)
+    (p.op == OP_AT ? obs_procs : obs_vars).insert(p.var_num);
+
+  for (auto& g: tc_find_symmetries(tc_parse_declarations(tcmd.get_source())))
+    {
+      sym_group sg;
+      std::vector<std::string> names;
+      for (size_t m = 0; m < g.processes.size(); ++m)
+        {
+          int pid = lookup(procidx, g.processes[m]);
+          if (pid < 0)
+            continue;
+          bool observed = obs_procs.count(pid);
+          std::vector<unsigned> vars;
+          std::vector<unsigned> dbmidx;
+          // Iterating over renaming[m] lists the owned identifiers in
+          // the same order for all members.
+          for (auto& [from, name]: g.renaming[m])
+            if (int v = lookup(intvars.index(), name); v >= 0)
+              {
+                for (unsigned k = 0, n = intvars.info(v).size(); k < n; ++k)
+                  {
+                    vars.push_back(v + k);
+                    observed |= obs_vars.count(v + k);
+                  }
+              }
+            else if (int c = lookup(clocks.index(), name); c >= 0)
+              {
+                for (unsigned k = 0, n = clocks.info(c).size(); k < n; ++k)
+                  dbmidx.push_back(c + k + 1);
+              }
+          if (observed)
+            continue;
+          sg.procs.push_back(pid);
+          names.push_back(g.processes[m]);
+          sg.vars.push_back(std::move(vars));
+          sg.clocks.push_back(std::move(dbmidx));
+        }
+      if (sg.procs.size() < 2)
+        continue;
+
+      std::vector<std::string> locnames;
+      for (const auto* loc: sys.locations())
+        if (loc->pid() == sg.procs[0])
+          locnames.push_back(loc->name());
+      sg.loc_rank.resize(sys.locations().size());
+      for (auto& name: names)
+        {
+          std::vector<unsigned> locs;
+          for (auto& l: locnames)
+            {
+              unsigned id = sys.location(name, l)->id();
+              sg.loc_rank[id] = locs.size();
+              locs.push_back(id);
+            }
+          sg.locs.push_back(std::move(locs));
+        }
+      res.push_back(std::move(sg));
+    }
+  return res;
+}
+
+// Compute the locations where tcltl_kripke::ample_successors() may
+// restrict the successors to those of the process at that location,
+// for partial-order reduction.  This is a static approximation of
+// the conditions for ample sets.  A location l of process P is
+// selected if:
+//  - P is not observed by PS, and l is neither committed nor urgent,
+//  - no edge leaving l synchronizes with other processes, tests or
+//    resets clocks, or leads to a committed or urgent location or to
+//    a location with a different invariant, so that these edges do
+//    not change the zone,
+//  - the variables read by these edges are not written by other
+//    processes, and those written by these edges are neither read or
+//    written by other processes, nor observed by PS,
+//  - l cannot reach a cycle made only of selected locations, so
+//    that no cycle of the reduced state space postpones the other
+//    processes forever.
+// The first three conditions make the edges of l independent from
+// all other transitions and invisible, so the reduction preserves
+// stutter-invariant properties (LTL without X).
+//
+// TChecker has no local-time zones, so transitions that involve
+// clocks are never reduced.  With local extrapolations, zones reached
+// through different interleavings may differ by extrapolation only.
+static std::vector<bool> make_por_locations(const tc_model_details& tcmd,
+                                            const prop_list& ps)
+{
+  const auto& sys = tcmd.model->system();
+  const auto& procidx = sys.processes();
+  const auto& varidx = tcmd.model->system_integer_variables().index();
+  tc_model_info info(tc_parse_declarations(tcmd.get_source()));
+
+  std::set<std::string> obs_procs;
+  std::set<std::string> obs_vars;
+  for (const one_prop& p: ps)
+    if (p.op == OP_AT)
+      obs_procs.insert(procidx.value(p.var_num));
+    else
+      obs_vars.insert(varidx.value(p.var_num));
+
+  // Processes reading and writing each variable.
+  std::map<std::string, std::set<std::string>> readers;
+  std::map<std::string, std::set<std::string>> writers;
+  for (auto& e: info.edges)
+    {
+      for (auto& v: e.reads)
+        readers[v].insert(e.process);
+      for (auto& v: e.writes)
+        writers[v].insert(e.process);
+    }
+  for (auto& l: info.locations)
+    for (auto& v: l.reads)
+      readers[v].insert(l.process);
+  auto only = [](const std::map<std::string, std::set<std::string>>& m,
+                 const std::string& v, const std::string& p)
+    {
+      auto it = m.find(v);
+      return it == m.end() || (it->second.size() == 1
+                               && *it->second.begin() == p);
+    };
+
+  typedef std::pair<std::string, std::string> loc_name;
+  std::map<loc_name, const tc_location_info*> locs;
+  std::set<loc_name> selected;
+  for (auto& l: info.locations)
+    {
+      locs[{l.process, l.name}] = &l;
+      if (!obs_procs.count(l.process) && !l.committed && !l.urgent)
+        selected.insert({l.process, l.name});
+    }
+  for (auto& e: info.edges)
+    {
+      loc_name src{e.process, e.src};
+      if (!selected.count(src))
+        continue;
+      auto tgt = locs.find({e.process, e.tgt});
+      bool ok = !e.synchronized && e.clock_guards.empty()
+        && e.clock_resets.empty() && tgt != locs.end()
+        && !tgt->second->committed && !tgt->second->urgent
+        && tgt->second->invariant == locs[src]->invariant;
+      for (auto& v: e.reads)
+        ok &= only(writers, v, e.process);
+      for (auto& v: e.writes)
+        ok &= only(readers, v, e.process) && only(writers, v, e.process)
+          && !obs_vars.count(v);
+      if (!ok)
+        selected.erase(src);
+    }
+
+  // Remove the selected locations that can reach a cycle using only
+  // edges leaving selected locations.  This is done by repeatedly
+  // removing the locations without such edges, as in a topological
+  // sort: whatever remains is on a cycle, or leads to one.
+  std::map<loc_name, unsigned> outdeg;
+  std::map<loc_name, std::vector<loc_name>> preds;
+  for (auto& e: info.edges)
+    {
+      loc_name src{e.process, e.src};
+      if (!selected.count(src))
+        continue;
+      ++outdeg[src];
+      preds[{e.process, e.tgt}].push_back(src);
+    }
+  std::vector<loc_name> todo;
+  for (auto& l: locs)
+    if (!outdeg[l.first])
+      todo.push_back(l.first);
+  while (!todo.empty())
+    {
+      loc_name l = todo.back();
+      todo.pop_back();
+      for (auto& p: preds[l])
+        if (--outdeg[p] == 0)
+          todo.push_back(p);
+    }
+
+  std::vector<bool> res(sys.locations().size(), false);
+  for (auto& l: selected)
+    if (!outdeg[l])
+      res[sys.location(l.first, l.second)->id()] = true;
+  return res;
+}
+
+// Information used to reset dead variables (kripke_dead_vars).
+// live[l] lists the integer variables that are live at location l
+// (by id), reset[v] is the value given to variable v when it is
+// dead, and keep[v] tells whether v should never be reset because it
+// is observed.
+struct dead_vars_info
+{
+  std::vector<std::vector<unsigned>> live;
+  std::vector<tchecker::integer_t> reset;
+  std::vector<bool> keep;
+};
+
+static dead_vars_info make_dead_vars(const tc_model_details& tcmd,
+                                     const prop_list& ps)
+{
+  const auto& sys = tcmd.model->system();
+  const auto& intvars = tcmd.model->system_integer_variables();
+  unsigned nvars = tcmd.model->flattened_integer_variables().size();
+  tc_liveness lv =
+    tc_live_variables(tc_model_info(tc_parse_declarations(tcmd.get_source())));
+
+  dead_vars_info res;
+  res.live.resize(sys.locations().size());
+  res.reset.resize(nvars);
+  res.keep.resize(nvars, false);
+  for (const auto v: intvars.index())
+    {
+      unsigned id = intvars.index().key(v);
+      const auto& info = intvars.info(id);
+      for (unsigned k = 0; k < info.size(); ++k)
+        res.reset[id + k] = info.initial_value();
+    }
+  for (const one_prop& p: ps)
+    if (p.op != OP_AT)
+      res.keep[p.var_num] = true;
+  for (auto& [loc, vars]: lv)
+    {
+      unsigned l = sys.location(loc.first, loc.second)->id();
+      for (auto& v: vars)
+        if (int id = lookup(intvars.index(), v); id >= 0)
+          for (unsigned k = 0, n = intvars.info(id).size(); k < n; ++k)
+            res.live[l].push_back(id + k);
+    }
+  return res;
+}
+
+// Compute the clocks that are active at each location (by id), as
+// DBM indices, for kripke_active_clocks.  A clock is active at a
+// location if the process may read it before resetting it (see
+// tc_live_variables()).
+static std::vector<std::vector<unsigned>>
+make_active_clocks(const tc_model_details& tcmd)
+{
+  const auto& sys = tcmd.model->system();
+  const auto& clocks = tcmd.model->system_clock_variables();
+  tc_liveness lv =
+    tc_live_variables(tc_model_info(tc_parse_declarations(tcmd.get_source())),
+                      true);
+
+  std::vector<std::vector<unsigned>> res(sys.locations().size());
+  for (auto& [loc, names]: lv)
+    {
+      unsigned l = sys.location(loc.first, loc.second)->id();
+      for (auto& x: names)
+        if (int id = lookup(clocks.index(), x); id >= 0)
+          for (unsigned k = 0, n = clocks.info(id).size(); k < n; ++k)
+            res[l].push_back(id + k + 1);
+    }
+  return res;
+}
+
+// The clock constraints and resets of one step of a run, copied
+// from a TChecker transition (TChecker reuses its transition objects).
+// A step without transition (the self-loop of a dead state) has no
+// guard and no reset, and SRC_INV and TGT_INV are both the invariant
+// of the state.
+struct timed_step_info
+{
+  tchecker::clock_constraint_container_t src_inv;
+  tchecker::clock_constraint_container_t guard;
+  tchecker::clock_reset_container_t resets;
+  tchecker::clock_constraint_container_t tgt_inv;
+};
+
+// A bound c - k*eps on a difference of time points, where eps is a
+// positive infinitesimal (k = 1 encodes a strict bound c).
+struct eps_bound
+{
+  int64_t c;
+  int64_t k;
+
+  bool operator<(const eps_bound& o) const
+  {
+    return c < o.c || (c == o.c && k > o.k);
+  }
+
+  eps_bound operator+(const eps_bound& o) const
+  {
+    return {c + o.c, k + o.k};
+  }
+
+  eps_bound operator-(const eps_bound& o) const
+  {
+    return {c - o.c, k - o.k};
+  }
+};
+
+// Difference constraints T_i - T_j <= bound over the time points of
+// a run.  T_0 is the start of the run, and T_{j+1} the date of its
+// j-th transition.
+class time_constraints
+{
+public:
+  time_constraints(unsigned steps, unsigned nclocks)
+    : n_(steps + 1), ref_(nclocks, 0), off_(nclocks, 0)
+  {
+  }
+
+  // T_I - T_J <= B.
+  void add(unsigned i, unsigned j, eps_bound b)
+  {
+    if (i == j)
+      infeasible_ |= b < eps_bound{0, 0};
+    else
+      edges_.push_back({i, j, b});
+  }
+
+  // Require the clock constraints CS to hold at time point T, given
+  // the current resets.
+  void constrain(unsigned t, const tchecker::clock_constraint_container_t& cs)
+  {
+    for (auto& cc: cs)
+      {
+        // The value of clock x at T_t is T_t - T_{ref_[x]} + off_[x],
+        // and that of the reference clock is 0.
+        unsigned i = t;
+        unsigned j = t;
+        int64_t c = cc.value();
+        if (cc.id1() != tchecker::REFCLOCK_ID)
+          {
+            j = ref_[cc.id1()];
+            c -= off_[cc.id1()];
+          }
+        if (cc.id2() != tchecker::REFCLOCK_ID)
+          {
+            i = ref_[cc.id2()];
+            c += off_[cc.id2()];
+          }
+        bool strict =
+          cc.comparator() == tchecker::clock_constraint_t::LT;
+        add(i, j, {c, strict});
+      }
+  }
+
+  // Apply the resets RS of the transition at time point T.
+  void reset(unsigned t, const tchecker::clock_reset_container_t& rs)
+  {
+    for (auto& r: rs)
+      if (r.right_id() == tchecker::REFCLOCK_ID)
+        {
+          ref_[r.left_id()] = t;
+          off_[r.left_id()] = r.value();
+        }
+      else
+        {
+          ref_[r.left_id()] = ref_[r.right_id()];
+          off_[r.left_id()] = off_[r.right_id()] + r.value();
+        }
+  }
+
+  // The time point of the last reset of each clock, and its offset.
+  const std::vector<unsigned>& refs() const
+  {
+    return ref_;
+  }
+
+  const std::vector<int64_t>& offsets() const
+  {
+    return off_;
+  }
+
+  // Solve the constraints with the Bellman-Ford algorithm, and return
+  // the time points relative to T_0, or an empty vector if there is
+  // no solution.
+  std::vector<eps_bound> solve() const
+  {
+    if (infeasible_)
+      return {};
+    std::vector<eps_bound> d(n_, eps_bound{0, 0});
+    for (unsigned round = 0;; ++round)
+      {
+        bool changed = false;
+        for (auto& e: edges_)
+          if (eps_bound b = d[e.j] + e.b; b < d[e.i])
+            {
+              d[e.i] = b;
+              changed = true;
+            }
+        if (!changed)
+          break;
+        if (round == n_)
+          return {};
+      }
+    eps_bound t0 = d[0];
+    for (auto& b: d)
+      b = b - t0;
+    return d;
+  }
+
+  // A denominator D such that replacing eps by 1/D in a solution
+  // satisfies all constraints.
+  int64_t denominator() const
+  {
+    int64_t k = 0;
+    for (auto& e: edges_)
+      k += std::abs(e.b.k);
+    return 3 * k + 1;
+  }
+
+private:
+  struct edge
+  {
+    unsigned i;
+    unsigned j;
+    eps_bound b;
+  };
+  unsigned n_;
+  std::vector<edge> edges_;
+  std::vector<unsigned> ref_;
+  std::vector<int64_t> off_;
+  bool infeasible_ = false;
+};
+
+// Compute the dates of the transitions of a run whose steps are
+// described by STEPS, with the cycle starting at step CYCLE (the last
+// step returns to that state).  Store in REFS and OFFS the resets in
+// effect when each state is entered (see time_constraints), and in
+// DEN a denominator for the dates.  The solution also requires the
+// clocks to have the same values at the end of the cycle as at its
+// start if possible (using the period of a solution without that
+// requirement), and REPEATABLE tells whether it does.
+static std::vector<eps_bound>
+solve_timed_run(const std::vector<timed_step_info>& steps, unsigned cycle,
+                unsigned nclocks, int64_t& den, bool& repeatable,
+                std::vector<std::vector<unsigned>>& refs,
+                std::vector<std::vector<int64_t>>& offs)
+{
+  unsigned n = steps.size();
+  auto build = [&](time_constraints& tc)
+    {
+      refs.clear();
+      offs.clear();
+      for (unsigned j = 0; j < n; ++j)
+        {
+          refs.push_back(tc.refs());
+          offs.push_back(tc.offsets());
+          // The invariant must hold on entering the state and when
+          // leaving it, hence all along since it is convex.
+          tc.constrain(j, steps[j].src_inv);
+          tc.constrain(j + 1, steps[j].src_inv);
+          tc.constrain(j + 1, steps[j].guard);
+          tc.add(j, j + 1, {0, 0});
+          tc.reset(j + 1, steps[j].resets);
+          tc.constrain(j + 1, steps[j].tgt_inv);
+        }
+      refs.push_back(tc.refs());
+      offs.push_back(tc.offsets());
+    };
+
+  time_constraints tc(n, nclocks);
+  build(tc);
+  std::vector<eps_bound> t = tc.solve();
+  if (t.empty())
+    throw std::runtime_error("the run has no concrete timed counterpart");
+  den = tc.denominator();
+  repeatable = false;
+  if (cycle >= n)
+    return t;
+
+  // The value of clock x on entering state j is
+  // T_j - T_{refs[j][x]} + offs[j][x].  With the period P fixed, the
+  // equality between the values at the start and at the end of the
+  // cycle becomes a difference constraint.
+  eps_bound period = t[n] - t[cycle];
+  time_constraints rtc(n, nclocks);
+  build(rtc);
+  rtc.add(n, cycle, period);
+  rtc.add(cycle, n, eps_bound{0, 0} - period);
+  for (unsigned x = 0; x < nclocks; ++x)
+    {
+      unsigned a = refs[cycle][x];
+      unsigned b = refs[n][x];
+      if (a == b)
+        {
+          // x is not reset along the cycle, so no time may elapse.
+          rtc.add(n, cycle, {0, 0});
+          continue;
+        }
+      // T_cycle - T_a + off_a = T_n - T_b + off_b
+      //   <=> T_b - T_a = P + off_b - off_a
+      eps_bound diff = period + eps_bound{offs[n][x] - offs[cycle][x], 0};
+      rtc.add(b, a, diff);
+      rtc.add(a, b, eps_bound{0, 0} - diff);
+    }
+  if (std::vector<eps_bound> rt = rtc.solve(); !rt.empty())
+    {
+      repeatable = true;
+      den = rtc.denominator();
+      return rt;
+    }
+  return t;
+}
+
 // Spot wrapper around a TChercker shared_state_ptr_t.
 //
 // FIXME: The Spot wrapper is itself reference counted, so it makes
@@ -163,7 +758,15 @@ private:
 // also provide the option to add a self-loop to states when the
 // selfloop argument is given (in this case, the iterator is ignored).
 //
-// We could have separated these behavior into two classes that
+// When the Kripke structure is built with kripke_non_zeno, the
+// source state is also given (as src) so that acc() can tell
+// whether the current transition lets time progress.
+//
+// Finally, the Kripke structure may have selected a subset of the
+// successors (for partial-order reduction), in which case it passes
+// them to set_list() and the iterator is ignored as well.
+//
+// We could have separated these behavior into several classes that
 // inherit from spot::kripke_succ_iterator (one for the normal
 // wrapping of TChecker's iterator, another one for the looping case)
 // but that makes recycling harder (by requiring a slow dynamic_cast
@@ -172,46 +775,85 @@ template <typename ITERATOR, typename KRIPKE>
 class tcltl_succ_iterator final: public spot::kripke_succ_iterator
 {
 public:
+  // Successors, with the acceptance marks of the transitions
+  // leading to them.
+  typedef std::vector<std::pair<const spot::state*,
+                                spot::acc_cond::mark_t>> succ_list;
+
   tcltl_succ_iterator(const KRIPKE* aut,
                       ITERATOR start, bdd cond,
-                      const spot::state* selfloop)
+                      const spot::state* selfloop,
+                      const spot::state* src)
     : kripke_succ_iterator(cond), aut_(aut), start_(start), pos_(start),
-      selfloop_(selfloop), done_(false)
+      selfloop_(selfloop), src_(src), done_(false), use_list_(false),
+      list_pos_(0)
   {
   }
 
-  void recycle(ITERATOR start, bdd cond, const spot::state* selfloop)
+  void recycle(ITERATOR start, bdd cond, const spot::state* selfloop,
+               const spot::state* src)
   {
     kripke_succ_iterator::recycle(cond);
     start_ = start;
     pos_ = start;
     selfloop_ = selfloop;
+    if (src_)
+      src_->destroy();
+    src_ = src;
     done_ = false;
+    release_list();
   }
 
   ~tcltl_succ_iterator()
   {
     if (selfloop_)
       selfloop_->destroy();
+    if (src_)
+      src_->destroy();
+    release_list();
+  }
+
+  // Iterate over the successors in LIST (which is swapped with an
+  // empty list).  The iterator takes ownership of these states.
+  void set_list(succ_list& list)
+  {
+    list_.swap(list);
+    use_list_ = true;
+    list_pos_ = 0;
   }
 
 private:
+  void release_list()
+  {
+    for (auto& p: list_)
+      p.first->destroy();
+    list_.clear();
+    use_list_ = false;
+  }
+
   bool is_done() const
   {
+    if (use_list_)
+      return list_pos_ >= list_.size();
     return selfloop_ ? done_ : pos_.at_end();
   }
 
 public:
   virtual bool first() override
   {
-    pos_ = start_;
+    if (use_list_)
+      list_pos_ = 0;
+    else
+      pos_ = start_;
     done_ = false;
     return !is_done();
   }
 
   virtual bool next() override
   {
-    if (selfloop_)
+    if (use_list_)
+      ++list_pos_;
+    else if (selfloop_)
       done_ = true;
     else
       ++pos_;
@@ -225,29 +867,53 @@ public:
 
   virtual spot::state* dst() const override
   {
+    if (use_list_)
+      return list_[list_pos_].first->clone();
     if (selfloop_)
       return selfloop_->clone();
     auto [st, trans] = *pos_;
+    aut_->canonicalize(st);
     return new(aut_->allocate_state())
       tcltl_state<KRIPKE, typename KRIPKE::state_ptr_t>(aut_, st);
   }
 
+  virtual spot::acc_cond::mark_t acc() const override
+  {
+    if (use_list_)
+      return list_[list_pos_].second;
+    if (!src_)
+      return {};
+    bool progress;
+    if (selfloop_)
+      progress = aut_->is_time_divergent(src_);
+    else
+      progress = aut_->is_progress_transition(src_, *std::get<1>(*pos_));
+    if (progress)
+      return {0};
+    return {};
+  }
+
 private:
   const KRIPKE* aut_;
   ITERATOR start_;
   ITERATOR pos_;
   const spot::state* selfloop_;
+  const spot::state* src_;
   bool done_;
+  bool use_list_;
+  unsigned list_pos_;
+  succ_list list_;
 };
 
 
 template <typename ZONE>
-class tcltl_kripke final: public spot::kripke
+class tcltl_kripke final: public tc_kripke
 {
 public:
   using zg_t = ZONE;
   using state_t = typename zg_t::shared_state_t;
   using state_ptr_t = typename zg_t::shared_state_ptr_t;
+  using transition_t = typename zg_t::transition_t;
   using state_allocator_t =
     typename zg_t::template state_pool_allocator_t<state_t>;
   using transition_allocator_t =
@@ -260,6 +926,7 @@ public:
   using tcltl_succiter_t =
     tcltl_succ_iterator<typename builder_t::outgoing_iterator_t, tcltl_kripke>;
   using tcltl_state_t = tcltl_state<tcltl_kripke, state_ptr_t>;
+  using succ_list = typename tcltl_succiter_t::succ_list;
 private:
   // Keep a shared pointer to the model and system so that they are
   // not deallocated before this Kripke structure.
@@ -284,19 +951,78 @@ private:
   bdd alive_prop;
   bdd dead_prop;
   mutable spot::fixed_size_pool statepool_;
+  bool non_zeno_;
+  // Reused by format_state(), which is called once per state when
+  // exporting a state space.
+  mutable tchecker::zg::ta::state_outputter_t state_outputter_;
+  mutable std::ostringstream format_buf_;
+  // Symmetry groups (empty unless kripke_symmetry is used), and
+  // scratch buffers for canonicalize().
+  sym_groups sym_;
+  mutable std::vector<unsigned> sym_order_;
+  mutable std::vector<unsigned> sym_locs_;
+  mutable std::vector<tchecker::integer_t> sym_vals_;
+  mutable std::vector<unsigned> sym_perm_;
+  mutable std::vector<tchecker::dbm::db_t> sym_dbm_;
+  // For partial-order reduction, whether each location (by id) is
+  // one where ample sets may be used (empty unless kripke_por is
+  // used), and scratch lists for ample_successors().
+  std::vector<bool> por_;
+  mutable std::vector<std::pair<state_ptr_t, spot::acc_cond::mark_t>> por_all_;
+  mutable succ_list succ_list_;
+  // Whether stutter-step collapsing is enabled.
+  bool stutter_;
+  // The result of stutter_successors() for a state: the states that
+  // leave its region, and whether that region has a cycle.  It is
+  // shared by all the states of a strongly connected component of a
+  // region, and computed once for each state.
+  struct stutter_exits
+  {
+    std::vector<const spot::state*> states;
+    bool loops = false;
+
+    ~stutter_exits()
+    {
+      for (auto* s: states)
+        s->destroy();
+    }
+  };
+  mutable std::unordered_map<const spot::state*,
+                             std::shared_ptr<stutter_exits>,
+                             spot::state_ptr_hash, spot::state_ptr_equal>
+    stutter_memo_;
+  // Dead variables (empty unless kripke_dead_vars is used), and a
+  // scratch vector for reset_dead_vars().
+  dead_vars_info dead_vars_;
+  mutable std::vector<bool> dead_live_;
+  // Active clocks at each location (empty unless
+  // kripke_active_clocks is used), and a scratch vector for
+  // free_inactive_clocks().
+  std::vector<std::vector<unsigned>> active_;
+  mutable std::vector<bool> active_live_;
+  // Owned by the "tcltl-stats" named property.
+  tc_kripke_stats* stats_;
+  // Cache for props_in().
+  mutable std::unordered_map<int, std::pair<bdd, std::vector<unsigned>>>
+    support_props_;
+  // Cache for loc_distances().
+  mutable std::unordered_map<unsigned, std::vector<unsigned>> loc_dist_;
 public:
 
   tcltl_kripke(tc_model_details_ptr tcmd,
                const spot::bdd_dict_ptr& dict,
-               const prop_list* ps, spot::formula dead)
-    : kripke(dict),
+               const prop_list* ps, spot::formula dead, unsigned opts)
+    : tc_kripke(dict),
       tcmd_(tcmd),
       ts_(*tcmd->model),
       allocator_(unused_gc_,
                  std::make_tuple(*tcmd->model, 100000), std::tuple<>()),
       builder_(ts_, allocator_),
       ps_(ps),
-      statepool_(sizeof(tcltl_state_t))
+      statepool_(sizeof(tcltl_state_t)),
+      non_zeno_(opts & kripke_non_zeno),
+      state_outputter_(tcmd->model->system_integer_variables().index(),
+                       tcmd->model->system_clock_variables().index())
   {
     // Register the "dead" proposition.  There are three cases to
     // consider:
@@ -327,6 +1053,28 @@ public:
         dead_prop = bdd_ithvar(var);
         alive_prop = bdd_nithvar(var);
       }
+    // With kripke_non_zeno, the transitions letting time progress
+    // are marked by acc() in tcltl_succ_iterator, and an accepting
+    // run must go through them infinitely often.
+    if (non_zeno_)
+      set_buchi();
+    if (opts & kripke_symmetry)
+      sym_ = make_sym_groups(*tcmd, *ps);
+    if (opts & kripke_por)
+      por_ = make_por_locations(*tcmd, *ps);
+    // The acceptance marks of collapsed transitions would have to be
+    // combined along paths and cycles, so kripke_stutter is ignored
+    // with kripke_non_zeno.
+    stutter_ = (opts & kripke_stutter) && !non_zeno_;
+    if (opts & kripke_dead_vars)
+      dead_vars_ = make_dead_vars(*tcmd, *ps);
+    // is_progress_transition() needs the lower bounds of the clocks
+    // that are reset, even if they are inactive.
+    if ((opts & kripke_active_clocks) && !non_zeno_)
+      active_ = make_active_clocks(*tcmd);
+    stats_ = new tc_kripke_stats;
+    stats_->clocks = tcmd->model->flattened_clock_variables().size();
+    set_named_prop("tcltl-stats", stats_);
   }
 
   ~tcltl_kripke()
@@ -336,6 +1084,9 @@ public:
         delete iter_cache_;
         iter_cache_ = nullptr;
       }
+    for (auto& p: stutter_memo_)
+      p.first->destroy();
+    stutter_memo_.clear();
     tofree_.clear();
     dict_->unregister_all_my_variables(ps_);
     delete ps_;
@@ -354,7 +1105,8 @@ public:
           typename builder_t::transition_ptr_t trans;
           std::tie(st, trans) = *it;
           first = false;
-          res = new(statepool_.allocate()) tcltl_state_t(this, st);
+          canonicalize(st);
+          res = new(allocate_state()) tcltl_state_t(this, st);
         }
       else
         {
@@ -365,12 +1117,24 @@ public:
 
   virtual
   tcltl_succiter_t* succ_iter(const spot::state* st) const override
+  {
+    return make_succ_iter(st, state_condition(st));
+  }
+
+  virtual
+  tcltl_succiter_t* succ_iter(const spot::state* st,
+                              bdd support) const override
+  {
+    return make_succ_iter(st, state_condition(st, support));
+  }
+
+  // The successors of ST, whose (possibly partial) label is SCOND.
+  tcltl_succiter_t* make_succ_iter(const spot::state* st, bdd scond) const
   {
     check_tofree();
     auto zs = spot::down_cast<const tcltl_state_t*>(st);
     state_ptr_t& z = zs->zg_state();
     auto beg = builder_.outgoing(z).begin();
-    bdd scond = state_condition(st);
     bool want_loop = false;
     if (!beg.at_end())
       {
@@ -382,357 +1146,1423 @@ public:
         want_loop = scond != bddfalse;
       }
 
+    bool reduced = false;
+    if (!beg.at_end())
+      {
+        if (stutter_)
+          {
+            stutter_successors(zs, succ_list_);
+            reduced = true;
+          }
+        else if (!por_.empty())
+          {
+            reduced = ample_successors(zs, beg, succ_list_);
+          }
+      }
+
+    const spot::state* src = non_zeno_ ? st->clone() : nullptr;
+    tcltl_succiter_t* it;
     if (iter_cache_)
       {
-        tcltl_succiter_t* it =
-          spot::down_cast<tcltl_succiter_t*>(iter_cache_);
-        it->recycle(beg, scond, want_loop ? st->clone() : nullptr);
+        it = spot::down_cast<tcltl_succiter_t*>(iter_cache_);
+        it->recycle(beg, scond, want_loop ? st->clone() : nullptr, src);
         iter_cache_ = nullptr;
-        return it;
       }
-    return new tcltl_succiter_t(this, beg, scond,
-                                want_loop ? st->clone() : nullptr);
-  }
-
-  void* allocate_state() const
-  {
-    return statepool_.allocate();
+    else
+      {
+        it = new tcltl_succiter_t(this, beg, scond,
+                                  want_loop ? st->clone() : nullptr, src);
+      }
+    if (reduced)
+      it->set_list(succ_list_);
+    return it;
   }
 
-  void check_tofree() const
+  // Add the successors of ST to OUT, with the acceptance marks of
+  // their transitions, applying the partial-order reduction if it is
+  // enabled.
+  void collect_successors(const tcltl_state_t* st, succ_list& out) const
   {
-    // The front of the deque is the oldest element released, so it
-    // should not be necessary to look elsewhere.
-    while (!tofree_.empty() && tofree_.front().refcount() == 1)
+    auto it = builder_.outgoing(st->zg_state()).begin();
+    if (!por_.empty() && ample_successors(st, it, out))
+      return;
+    for (; !it.at_end(); ++it)
       {
-        bool res = allocator_.destruct_state(tofree_.front());
-        assert(res); (void) res;
-        tofree_.pop_front();
+        auto [s, t] = *it;
+        spot::acc_cond::mark_t m = {};
+        if (non_zeno_ && is_progress_transition(st, *t))
+          m = {0};
+        canonicalize(s);
+        out.emplace_back(new(allocate_state()) tcltl_state_t(this, s), m);
       }
   }
 
-  void deallocate_state(const spot::state* st) const
+  // Stutter-step collapsing.  The region of ST is made of the states
+  // that are reachable from ST through transitions that do not
+  // change the state condition.  Fill OUT with the states that leave
+  // this region, i.e., the successors of the region with a different
+  // condition, and the dead states of the region.  If the region has
+  // a cycle, the run may stutter forever on the condition of ST, so a
+  // self-loop on ST is added as well.
+  //
+  // Each path of the Kripke structure is therefore stutter-equivalent
+  // to a path of the collapsed structure and vice versa, so this
+  // preserves stutter-invariant properties.  This assumes ST is not
+  // dead.
+  void stutter_successors(const tcltl_state_t* st, succ_list& out) const
   {
-    auto zs = spot::down_cast<const tcltl_state_t*>(st);
-    // We can't destruct() the zg_state() immediately because it may
-    // still be present in TChecker data structures (like iterators or
-    // builders used to create those) and have a refcount != 1.  This
-    // situation is very frequent, so even if refcount == 1, we
-    // enqueue the state into the tofree_ buffer, and will check
-    // the refcount later, when we create the next succ_iterator.
-    //
-    // Move so that it's as is zs was destroyed.
-    tofree_.push_back(std::move(zs->zg_state()));
-    statepool_.deallocate(const_cast<tcltl_state_t*>(zs));
+    auto it = stutter_memo_.find(st);
+    if (it == stutter_memo_.end())
+      {
+        stutter_explore(st);
+        it = stutter_memo_.find(st);
+      }
+    for (auto* s: it->second->states)
+      out.emplace_back(s->clone(), spot::acc_cond::mark_t{});
+    if (it->second->loops)
+      out.emplace_back(st->clone(), spot::acc_cond::mark_t{});
   }
 
-  virtual
-  bdd state_condition(const spot::state* st) const override
+  // Fill stutter_memo_ for ST and the states of its region that are
+  // not there yet.  The region of a state is that state plus the
+  // regions of its successors with the same condition, so the result
+  // for a strongly connected component of the region is the union of
+  // those of the components it leads to, plus its own exits.  The
+  // components are found with Tarjan's algorithm, and the states for
+  // which stutter_memo_ already has a result are not explored again.
+  // Each state is therefore expanded once, even when it belongs to
+  // the regions of many states (or when a run is relabeled).
+  void stutter_explore(const tcltl_state_t* st) const
   {
-    bdd cond = bddtrue;
-    auto zs = spot::down_cast<const tcltl_state_t*>(st)->zg_state();
-    auto& vals = zs->intvars_valuation();
-    auto& vloc = zs->vloc();
-    for (const one_prop& prop: *ps_)
+    bdd label = state_condition(st);
+    struct node
+    {
+      const spot::state* s;
+      // Successors with another condition, or the state itself if it
+      // is dead.
+      std::vector<const spot::state*> exits;
+      // Successors with the same condition, still to be visited.
+      std::vector<const spot::state*> pending;
+      unsigned next;
+      // Successors with the same condition, by node number, and
+      // results of those already in stutter_memo_.
+      std::vector<unsigned> region;
+      std::vector<std::shared_ptr<stutter_exits>> done;
+      unsigned low;
+      bool self_loop;
+      std::shared_ptr<stutter_exits> res;
+    };
+    std::vector<node> nodes;
+    std::unordered_map<const spot::state*, unsigned,
+                       spot::state_ptr_hash, spot::state_ptr_equal> num;
+    std::vector<unsigned> dfs;
+    std::vector<unsigned> scc;
+    succ_list succs;
+
+    auto push = [&](const spot::state* s)
       {
-        bool res = false;
-        if (prop.op == OP_AT)
+        unsigned n = nodes.size();
+        num.emplace(s, n);
+        nodes.push_back({s, {}, {}, 0, {}, {}, n, false, nullptr});
+        succs.clear();
+        collect_successors(spot::down_cast<const tcltl_state_t*>(s), succs);
+        if (succs.empty())
+          nodes[n].exits.push_back(s->clone());
+        for (auto [v, m]: succs)
+          (state_condition(v) == label
+           ? nodes[n].pending : nodes[n].exits).push_back(v);
+        dfs.push_back(n);
+        scc.push_back(n);
+      };
+
+    push(st->clone());
+    while (!dfs.empty())
+      {
+        unsigned n = dfs.back();
+        if (nodes[n].next < nodes[n].pending.size())
           {
-            res = vloc[prop.var_num]->id() == unsigned(prop.val);
+            const spot::state* v = nodes[n].pending[nodes[n].next++];
+            if (auto it = stutter_memo_.find(v); it != stutter_memo_.end())
+              {
+                nodes[n].done.push_back(it->second);
+                v->destroy();
+              }
+            else if (auto it = num.find(v); it != num.end())
+              {
+                // Completed nodes are in stutter_memo_, so this one
+                // is still on the stack of the current component.
+                unsigned w = it->second;
+                nodes[n].low = std::min(nodes[n].low, w);
+                nodes[n].self_loop |= w == n;
+                v->destroy();
+              }
+            else
+              {
+                nodes[n].region.push_back(nodes.size());
+                push(v);
+              }
+            continue;
           }
-        else
+        dfs.pop_back();
+        if (!dfs.empty())
           {
-            int val = vals[prop.var_num];
-            int ref = prop.val;
-            switch (prop.op)
+            unsigned p = dfs.back();
+            nodes[p].low = std::min(nodes[p].low, nodes[n].low);
+          }
+        if (nodes[n].low != n)
+          continue;
+
+        // N is the root of a component, made of the nodes above it
+        // on SCC.
+        auto res = std::make_shared<stutter_exits>();
+        spot::state_set seen;
+        auto add = [&](const spot::state* s)
+          {
+            if (seen.insert(s).second)
+              res->states.push_back(s->clone());
+          };
+        auto first = std::find(scc.begin(), scc.end(), n);
+        res->loops = scc.end() - first > 1 || nodes[n].self_loop;
+        for (auto i = first; i != scc.end(); ++i)
+          {
+            node& u = nodes[*i];
+            for (auto* s: u.exits)
               {
-              case OP_EQ:
-                res = val == ref;
-                break;
-              case OP_NE:
-                res = val != ref;
-                break;
-              case OP_LT:
-                res = val < ref;
-                break;
-              case OP_GT:
-                res = val > ref;
-                break;
-              case OP_LE:
-                res = val <= ref;
-                break;
-              case OP_GE:
-                res = val >= ref;
-                break;
-              case OP_AT:
-                // unreachable
-                break;
+                add(s);
+                s->destroy();
               }
+            u.exits.clear();
+            for (auto& r: u.done)
+              {
+                for (auto* s: r->states)
+                  add(s);
+                res->loops |= r->loops;
+              }
+            // The nodes of other components are complete.
+            for (unsigned w: u.region)
+              if (auto& r = nodes[w].res)
+                {
+                  for (auto* s: r->states)
+                    add(s);
+                  res->loops |= r->loops;
+                }
           }
-        cond &= (res ? bdd_ithvar : bdd_nithvar)(prop.bddvar);
+        for (auto i = first; i != scc.end(); ++i)
+          {
+            nodes[*i].res = res;
+            stutter_memo_.emplace(nodes[*i].s, res);
+          }
+        scc.erase(first, scc.end());
       }
-    return cond;
   }
 
-  virtual
-  std::string format_state(const spot::state *st) const override
+  // Partial-order reduction.  If some process P is at a location
+  // where all its edges are independent from other processes and
+  // invisible (see make_por_locations()), the successors obtained by
+  // moving P form an ample set, and only those need to be explored.
+  //
+  // The successors of ST are those of the TChecker iterator IT.  If
+  // some process has such a location, fill OUT with the selected
+  // successors (or all of them if no process at such a location can
+  // move) and return true.  Otherwise, return false without touching
+  // IT.
+  template <typename ITERATOR>
+  bool ample_successors(const tcltl_state_t* st, ITERATOR it,
+                        succ_list& out) const
   {
-    auto& model = ts_.model();
-    auto zs = spot::down_cast<const tcltl_state_t*>(st)->zg_state();
-    tchecker::zg::ta::state_outputter_t
-      so(model.system_integer_variables().index(),
-         model.system_clock_variables().index());
-    std::stringstream s;
-    so.output(s, *zs);
-    return s.str();
-  }
-
+    auto& vloc = st->zg_state()->vloc();
+    unsigned nproc = vloc.size();
+    unsigned p = 0;
+    while (p < nproc && !por_[vloc[p]->id()])
+      ++p;
+    if (p == nproc)
+      return false;
+
+    por_all_.clear();
+    for (; !it.at_end(); ++it)
+      {
+        auto [s, t] = *it;
+        spot::acc_cond::mark_t m = {};
+        if (non_zeno_ && is_progress_transition(st, *t))
+          m = {0};
+        por_all_.emplace_back(s, m);
+      }
+
+    int ample = -1;
+    for (; p < nproc && ample < 0; ++p)
+      if (unsigned l = vloc[p]->id(); por_[l])
+        for (auto& succ: por_all_)
+          if (succ.first->vloc()[p]->id() != l)
+            {
+              ample = p;
+              break;
+            }
+
+    for (auto& [s, m]: por_all_)
+      if (ample >= 0 && s->vloc()[ample]->id() == vloc[ample]->id())
+        {
+          stats_->zones.allocate(zone_bytes(*s));
+          release(std::move(s));
+        }
+      else
+        {
+          canonicalize(s);
+          out.emplace_back(new(allocate_state()) tcltl_state_t(this, s), m);
+        }
+    por_all_.clear();
+    return true;
+  }
+
+  // Whether taking transition T from state ST is guaranteed to let
+  // at least one time unit elapse since the previous visit of such a
+  // transition.  This is the case when T resets a clock x that is
+  // known to be >= 1, either because of the zone of ST or because of
+  // the guard of T.  Between two such resets of x, time must have
+  // increased by at least one unit, so a run that takes these
+  // transitions infinitely often is not Zeno.  (Runs that let time
+  // diverge without ever resetting a clock are not detected.)
+  bool is_progress_transition(const spot::state* st,
+                              const transition_t& t) const
+  {
+    auto& zone = spot::down_cast<const tcltl_state_t*>(st)
+      ->zg_state()->zone();
+    const tchecker::dbm::db_t* dbm = zone.dbm();
+    for (const auto& r: t.reset_container())
+      {
+        // DBM index of the reset clock; index 0 is the reference
+        // clock, and REFCLOCK_ID+1 wraps to 0.
+        tchecker::clock_id_t x = r.left_id() + 1;
+        // dbm[x] encodes 0 - x < c or 0 - x <= c.
+        if (tchecker::dbm::value(dbm[x]) <= -1)
+          return true;
+        for (const auto& c: t.guard_container())
+          if (c.id1() == tchecker::REFCLOCK_ID && c.id2() + 1 == x
+              && c.value() <= -1)
+            return true;
+      }
+    return false;
+  }
+
+  // Whether time can diverge while staying in state ST, i.e., no
+  // clock is bounded from above in its zone.  This is used for the
+  // self-loops added to dead states.  Note that it is only relevant
+  // with elapsed semantics, and that extrapolations may drop upper
+  // bounds of invariants, making this an approximation.
+  bool is_time_divergent(const spot::state* st) const
+  {
+    auto& zone = spot::down_cast<const tcltl_state_t*>(st)
+      ->zg_state()->zone();
+    const tchecker::dbm::db_t* dbm = zone.dbm();
+    tchecker::clock_id_t dim = zone.dim();
+    for (tchecker::clock_id_t x = 1; x < dim; ++x)
+      // dbm[x * dim] encodes x - 0 < c or x - 0 <= c.
+      if (dbm[x * dim] != tchecker::dbm::LT_INFINITY)
+        return false;
+    return true;
+  }
+
+  // Replace ST by the representative of its orbit under the
+  // permutations of the symmetry groups.  The members of each group
+  // are sorted according to their location, their variables, and the
+  // bounds of their clocks; ties are not broken further, so two
+  // symmetric states may still have different representatives.
+  // This is sound, it just makes the reduction less effective.
+  void canonicalize(state_ptr_t& st) const
+  {
+    if (!dead_vars_.live.empty())
+      reset_dead_vars(*st);
+    ++stats_->states;
+    if (!active_.empty())
+      stats_->active_clocks += free_inactive_clocks(*st);
+    else
+      stats_->active_clocks += stats_->clocks;
+    stats_->zones.allocate(zone_bytes(*st));
+    if (stats_->progress && !(stats_->states & 0xffff))
+      stats_->progress(*stats_);
+    for (const sym_group& g: sym_)
+      canonicalize(*st, g);
+  }
+
+  // The memory used by ST, as counted in tc_kripke_stats::zones.
+  static size_t zone_bytes(const state_t& st)
+  {
+    size_t dim = st.zone().dim();
+    return sizeof(state_t) + dim * dim * sizeof(tchecker::dbm::db_t)
+      + st.vloc().size() * sizeof(void*)
+      + st.intvars_valuation().size() * sizeof(tchecker::integer_t);
+  }
+
+  // Give a fixed value to the integer variables that no process may
+  // read before writing them (see tc_live_variables()), so that
+  // states that only differ by such values are merged.
+  void reset_dead_vars(state_t& st) const
+  {
+    auto& vloc = st.vloc();
+    auto& vals = writable(st.intvars_valuation());
+    dead_live_.assign(dead_vars_.keep.begin(), dead_vars_.keep.end());
+    for (unsigned p = 0, n = vloc.size(); p < n; ++p)
+      for (unsigned v: dead_vars_.live[vloc[p]->id()])
+        dead_live_[v] = true;
+    for (unsigned v = 0, n = dead_live_.size(); v < n; ++v)
+      if (!dead_live_[v])
+        vals[v] = dead_vars_.reset[v];
+  }
+
+  // Remove all constraints on the clocks that no process may read
+  // before resetting them, and return the number of remaining
+  // clocks.  For such a clock x, x - y is unbounded, and y - x is
+  // only bounded by y - 0 since x >= 0.  This keeps the DBM tight.
+  unsigned free_inactive_clocks(state_t& st) const
+  {
+    auto& vloc = st.vloc();
+    auto& zone = st.zone();
+    auto* dbm = const_cast<tchecker::dbm::db_t*>(zone.dbm());
+    unsigned dim = zone.dim();
+    active_live_.assign(dim, false);
+    for (unsigned p = 0, n = vloc.size(); p < n; ++p)
+      for (unsigned x: active_[vloc[p]->id()])
+        active_live_[x] = true;
+    unsigned active = 0;
+    for (unsigned x = 1; x < dim; ++x)
+      {
+        if (active_live_[x])
+          {
+            ++active;
+            continue;
+          }
+        for (unsigned y = 0; y < dim; ++y)
+          if (y != x)
+            {
+              dbm[x * dim + y] = tchecker::dbm::LT_INFINITY;
+              dbm[y * dim + x] = dbm[y * dim];
+            }
+      }
+    return active;
+  }
+
+  void canonicalize(state_t& st, const sym_group& g) const
+  {
+    auto& vloc = writable(st.vloc());
+    auto& vals = writable(st.intvars_valuation());
+    auto& zone = st.zone();
+    auto* dbm = const_cast<tchecker::dbm::db_t*>(zone.dbm());
+    unsigned dim = zone.dim();
+    unsigned n = g.procs.size();
+
+    auto rank = [&](unsigned m)
+      {
+        return g.loc_rank[vloc[g.procs[m]]->id()];
+      };
+    auto less = [&](unsigned a, unsigned b)
+      {
+        unsigned ra = rank(a);
+        unsigned rb = rank(b);
+        if (ra != rb)
+          return ra < rb;
+        for (unsigned k = 0, nv = g.vars[a].size(); k < nv; ++k)
+          if (vals[g.vars[a][k]] != vals[g.vars[b][k]])
+            return vals[g.vars[a][k]] < vals[g.vars[b][k]];
+        for (unsigned k = 0, nc = g.clocks[a].size(); k < nc; ++k)
+          {
+            unsigned xa = g.clocks[a][k];
+            unsigned xb = g.clocks[b][k];
+            // Compare the upper bounds (x - 0), then the lower bounds
+            // (0 - x) of both clocks.
+            if (dbm[xa * dim] != dbm[xb * dim])
+              return dbm[xa * dim] < dbm[xb * dim];
+            if (dbm[xa] != dbm[xb])
+              return dbm[xa] < dbm[xb];
+          }
+        return false;
+      };
+    sym_order_.resize(n);
+    std::iota(sym_order_.begin(), sym_order_.end(), 0);
+    std::stable_sort(sym_order_.begin(), sym_order_.end(), less);
+    bool identity = true;
+    for (unsigned m = 0; m < n; ++m)
+      identity &= sym_order_[m] == m;
+    if (identity)
+      return;
+
+    // Member m now gets the state of member sym_order_[m].
+    const auto& sys = ts_.model().system();
+    sym_locs_.clear();
+    sym_vals_.clear();
+    for (unsigned m = 0; m < n; ++m)
+      {
+        sym_locs_.push_back(rank(m));
+        for (unsigned v: g.vars[m])
+          sym_vals_.push_back(vals[v]);
+      }
+    unsigned nv = g.vars[0].size();
+    for (unsigned m = 0; m < n; ++m)
+      {
+        unsigned from = sym_order_[m];
+        vloc[g.procs[m]] = sys.location(g.locs[m][sym_locs_[from]]);
+        for (unsigned k = 0; k < nv; ++k)
+          vals[g.vars[m][k]] = sym_vals_[from * nv + k];
+      }
+
+    sym_perm_.resize(dim);
+    std::iota(sym_perm_.begin(), sym_perm_.end(), 0);
+    for (unsigned m = 0; m < n; ++m)
+      for (unsigned k = 0, nc = g.clocks[m].size(); k < nc; ++k)
+        sym_perm_[g.clocks[sym_order_[m]][k]] = g.clocks[m][k];
+    sym_dbm_.assign(dbm, dbm + dim * dim);
+    for (unsigned i = 0; i < dim; ++i)
+      for (unsigned j = 0; j < dim; ++j)
+        dbm[sym_perm_[i] * dim + sym_perm_[j]] = sym_dbm_[i * dim + j];
+  }
+
+  void* allocate_state() const
+  {
+    stats_->kripke_states.allocate(sizeof(tcltl_state_t));
+    return statepool_.allocate();
+  }
+
+  // Queue ST, a state of the zone graph that is no longer used, so
+  // that check_tofree() destructs it.
+  void release(state_ptr_t&& st) const
+  {
+    stats_->pending_zones.allocate(zone_bytes(*st));
+    tofree_.push_back(std::move(st));
+  }
+
+  void check_tofree() const
+  {
+    // The front of the deque is the oldest element released, so it
+    // should not be necessary to look elsewhere.
+    while (!tofree_.empty() && tofree_.front().refcount() == 1)
+      {
+        size_t bytes = zone_bytes(*tofree_.front());
+        bool res = allocator_.destruct_state(tofree_.front());
+        assert(res); (void) res;
+        tofree_.pop_front();
+        stats_->pending_zones.deallocate(bytes);
+        stats_->zones.deallocate(bytes);
+      }
+  }
+
+  void deallocate_state(const spot::state* st) const
+  {
+    auto zs = spot::down_cast<const tcltl_state_t*>(st);
+    // We can't destruct() the zg_state() immediately because it may
+    // still be present in TChecker data structures (like iterators or
+    // builders used to create those) and have a refcount != 1.  This
+    // situation is very frequent, so even if refcount == 1, we
+    // enqueue the state into the tofree_ buffer, and will check
+    // the refcount later, when we create the next succ_iterator.
+    //
+    // Move so that it's as is zs was destroyed.
+    release(std::move(zs->zg_state()));
+    statepool_.deallocate(const_cast<tcltl_state_t*>(zs));
+    stats_->kripke_states.deallocate(sizeof(tcltl_state_t));
+  }
+
+  // Evaluate PROP on the state whose locations and integer
+  // variables are VLOC and VALS.
+  template <typename VLOC, typename VALS>
+  static bool eval_prop(const one_prop& prop, const VLOC& vloc,
+                        const VALS& vals)
+  {
+    bool res = false;
+    if (prop.op == OP_AT)
+      {
+        res = vloc[prop.var_num]->id() == unsigned(prop.val);
+      }
+    else
+      {
+        int val = vals[prop.var_num];
+        int ref = prop.val;
+        switch (prop.op)
+          {
+          case OP_EQ:
+            res = val == ref;
+            break;
+          case OP_NE:
+            res = val != ref;
+            break;
+          case OP_LT:
+            res = val < ref;
+            break;
+          case OP_GT:
+            res = val > ref;
+            break;
+          case OP_LE:
+            res = val <= ref;
+            break;
+          case OP_GE:
+            res = val >= ref;
+            break;
+          case OP_AT:
+            // unreachable
+            break;
+          }
+      }
+    return res;
+  }
+
+  virtual
+  bdd state_condition(const spot::state* st) const override
+  {
+    bdd cond = bddtrue;
+    auto zs = spot::down_cast<const tcltl_state_t*>(st)->zg_state();
+    auto& vals = zs->intvars_valuation();
+    auto& vloc = zs->vloc();
+    for (const one_prop& prop: *ps_)
+      cond &= (eval_prop(prop, vloc, vals)
+               ? bdd_ithvar : bdd_nithvar)(prop.bddvar);
+    return cond;
+  }
+
+  virtual
+  bdd state_condition(const spot::state* st, bdd support) const override
+  {
+    bdd cond = bddtrue;
+    auto zs = spot::down_cast<const tcltl_state_t*>(st)->zg_state();
+    auto& vals = zs->intvars_valuation();
+    auto& vloc = zs->vloc();
+    for (unsigned i: props_in(support))
+      {
+        const one_prop& prop = (*ps_)[i];
+        cond &= (eval_prop(prop, vloc, vals)
+                 ? bdd_ithvar : bdd_nithvar)(prop.bddvar);
+      }
+    return cond;
+  }
+
+  // The positions in ps_ of the propositions whose variables appear
+  // in SUPPORT.  Products usually ask for the same few supports over
+  // and over, so they are cached (along with the BDD, so that its id
+  // is not reused).
+  const std::vector<unsigned>& props_in(bdd support) const
+  {
+    auto [it, inserted] = support_props_.try_emplace(support.id());
+    if (inserted)
+      {
+        it->second.first = support;
+        for (unsigned i = 0, n = ps_->size(); i < n; ++i)
+          if (bdd_implies(support, bdd_ithvar((*ps_)[i].bddvar)))
+            it->second.second.push_back(i);
+      }
+    return it->second.second;
+  }
+
+  virtual std::vector<std::pair<std::string, std::string>>
+  locations(const spot::state* st) const override
+  {
+    auto& vloc = spot::down_cast<const tcltl_state_t*>(st)
+      ->zg_state()->vloc();
+    const auto& procidx = ts_.model().system().processes();
+    std::vector<std::pair<std::string, std::string>> res;
+    for (unsigned p = 0, n = vloc.size(); p < n; ++p)
+      res.emplace_back(procidx.value(p), vloc[p]->name());
+    return res;
+  }
+
+  virtual std::vector<std::pair<std::string, int>>
+  intvars(const spot::state* st) const override
+  {
+    auto& vals = spot::down_cast<const tcltl_state_t*>(st)
+      ->zg_state()->intvars_valuation();
+    const auto& intvars = ts_.model().system_integer_variables();
+    const auto& idx = intvars.index();
+    std::vector<std::pair<std::string, int>> res;
+    for (const auto v: idx)
+      {
+        unsigned id = idx.key(v);
+        unsigned size = intvars.info(id).size();
+        if (size == 1)
+          res.emplace_back(idx.value(v), vals[id]);
+        else
+          for (unsigned k = 0; k < size; ++k)
+            res.emplace_back(idx.value(v) + '[' + std::to_string(k) + ']',
+                             vals[id + k]);
+      }
+    return res;
+  }
+
+  virtual tc_timed_run timed_run(const spot::twa_run& run) const override
+  {
+    if (stutter_ || !sym_.empty())
+      throw std::runtime_error("timed runs are not available with "
+                               "stutter-step collapsing or symmetry "
+                               "reduction");
+    std::vector<const tcltl_state_t*> path;
+    for (auto* steps: {&run.prefix, &run.cycle})
+      for (auto& step: *steps)
+        path.push_back(spot::down_cast<const tcltl_state_t*>(step.s));
+    unsigned cycle = run.prefix.size();
+    if (!run.cycle.empty())
+      path.push_back(path[cycle]);
+
+    // Recover the transition of each step.
+    std::vector<timed_step_info> steps;
+    for (unsigned j = 0; j + 1 < path.size(); ++j)
+      {
+        check_tofree();
+        timed_step_info info;
+        bool found = false;
+        auto it = builder_.outgoing(path[j]->zg_state()).begin();
+        bool dead = it.at_end();
+        for (; !it.at_end(); ++it)
+          {
+            auto [st, t] = *it;
+            canonicalize(st);
+            bool same = !found && *st == *path[j + 1]->zg_state();
+            release(std::move(st));
+            if (!same)
+              continue;
+            info.src_inv = t->src_invariant_container();
+            info.guard = t->guard_container();
+            info.resets = t->reset_container();
+            info.tgt_inv = t->tgt_invariant_container();
+            found = true;
+          }
+        if (!found && dead && !path[j]->compare(path[j + 1]))
+          {
+            // The self-loop of a dead state: time may elapse within
+            // the invariant of the state, which the previous step
+            // knows.
+            if (!steps.empty())
+              info.src_inv = info.tgt_inv = steps.back().tgt_inv;
+            found = true;
+          }
+        if (!found)
+          throw std::runtime_error("a step of the run is not a transition "
+                                   "of the model");
+        steps.push_back(std::move(info));
+      }
+
+    const auto& clocks = tcmd_->model->flattened_clock_variables();
+    unsigned nclocks = clocks.size();
+    tc_timed_run res;
+    for (unsigned x = 0; x < nclocks; ++x)
+      res.clocks.push_back(clocks.index().value(x));
+    std::vector<std::vector<unsigned>> refs;
+    std::vector<std::vector<int64_t>> offs;
+    std::vector<eps_bound> t =
+      solve_timed_run(steps, cycle, nclocks, res.denominator,
+                      res.repeatable, refs, offs);
+    int64_t den = res.denominator;
+    auto date = [&](unsigned i)
+      {
+        return t[i].c * den - t[i].k;
+      };
+    for (unsigned j = 0; j < path.size(); ++j)
+      {
+        if (j == path.size() - 1 && !run.cycle.empty())
+          break;
+        tc_timed_step step;
+        step.locations = locations(path[j]);
+        for (unsigned x = 0; x < nclocks; ++x)
+          step.clocks.push_back(date(j) - date(refs[j][x])
+                                + offs[j][x] * den);
+        if (j < steps.size())
+          step.delay = date(j + 1) - date(j);
+        (j < cycle ? res.prefix : res.cycle).push_back(std::move(step));
+      }
+    // Use the smallest denominator.
+    int64_t g = den;
+    for (auto* steps: {&res.prefix, &res.cycle})
+      for (auto& step: *steps)
+        {
+          g = std::gcd(g, step.delay);
+          for (auto v: step.clocks)
+            g = std::gcd(g, v);
+        }
+    res.denominator /= g;
+    for (auto* steps: {&res.prefix, &res.cycle})
+      for (auto& step: *steps)
+        {
+          step.delay /= g;
+          for (auto& v: step.clocks)
+            v /= g;
+        }
+    return res;
+  }
+
+  // Estimate the number of transitions needed to reach a state
+  // where one of the propositions whose variables appear in SUPPORT
+  // holds.  For a location proposition, this is the smallest
+  // distance from the current location of the process to that
+  // location in the graph of the process.  Since SUPPORT does not
+  // tell whether a comparison of an integer variable should become
+  // true or false, its distance is the number of steps needed for
+  // the variable to change the value of the comparison, as if each
+  // transition changed the variable by at most one (as counters do).
+  // Return 0 if SUPPORT has no proposition, and UINT_MAX if none of
+  // these locations is reachable and there is no comparison.
+  virtual
+  unsigned distance(const spot::state* st, bdd support) const override
+  {
+    auto zs = spot::down_cast<const tcltl_state_t*>(st)->zg_state();
+    auto& vloc = zs->vloc();
+    auto& vals = zs->intvars_valuation();
+    bool any = false;
+    unsigned res = -1U;
+    for (unsigned i: props_in(support))
+      {
+        const one_prop& prop = (*ps_)[i];
+        any = true;
+        if (prop.op == OP_AT)
+          res = std::min(res, loc_distances(prop.val)
+                         [vloc[prop.var_num]->id()]);
+        else
+          res = std::min(res, toggle_distance(prop, vals[prop.var_num]));
+      }
+    return any ? res : 0;
+  }
+
+  // The smallest change of VAL that changes the value of the
+  // comparison PROP.
+  static unsigned toggle_distance(const one_prop& prop, long long val)
+  {
+    long long ref = prop.val;
+    long long res = 0;
+    switch (prop.op)
+      {
+      case OP_EQ:
+        res = val == ref ? 1 : std::abs(val - ref);
+        break;
+      case OP_NE:
+        res = val != ref ? std::abs(val - ref) : 1;
+        break;
+      case OP_LT:
+        res = val < ref ? ref - val : val - ref + 1;
+        break;
+      case OP_GT:
+        res = val > ref ? val - ref : ref - val + 1;
+        break;
+      case OP_LE:
+        res = val <= ref ? ref - val + 1 : val - ref;
+        break;
+      case OP_GE:
+        res = val >= ref ? val - ref + 1 : ref - val;
+        break;
+      case OP_AT:
+        // unreachable
+        break;
+      }
+    return std::min(res, (long long) -1U - 1);
+  }
+
+  // The distance from each location to location TGT (by id), in the
+  // graph of the process of TGT.  Locations of other processes are
+  // at distance UINT_MAX.
+  const std::vector<unsigned>& loc_distances(unsigned tgt) const
+  {
+    auto [it, inserted] = loc_dist_.try_emplace(tgt);
+    std::vector<unsigned>& dist = it->second;
+    if (inserted)
+      {
+        const auto& preds = tcmd_->loc_preds;
+        dist.resize(preds.size(), -1U);
+        std::deque<unsigned> todo;
+        dist[tgt] = 0;
+        todo.push_back(tgt);
+        while (!todo.empty())
+          {
+            unsigned l = todo.front();
+            todo.pop_front();
+            for (unsigned p: preds[l])
+              if (dist[p] == -1U)
+                {
+                  dist[p] = dist[l] + 1;
+                  todo.push_back(p);
+                }
+          }
+      }
+    return dist;
+  }
+
+  virtual
+  std::string format_state(const spot::state *st) const override
+  {
+    auto& zs = spot::down_cast<const tcltl_state_t*>(st)->zg_state();
+    format_buf_.str("");
+    state_outputter_.output(format_buf_, *zs);
+    return format_buf_.str();
+  }
+
 };
 
-// Convert a set of atomic propositions (seen as strings) into a kind
-// of byte-code (prop_list) that encode the associated query.  At some
-// point this service should be offered by TChecker, so that we do not
-// have to depend on the way variables are stored, and so that we do
-// not even have to decide on the syntax to use for those
-// propositions.
-// https://github.com/ticktac-project/tchecker/issues/21
-void convert_aps(const spot::atomic_prop_set* aps,
-                 const tchecker::zg::ta::model_t& model,
-                 spot::bdd_dict_ptr dict, spot::formula dead,
-                 prop_list& out)
+// Parse the atomic proposition STR into RES (except for its bddvar).
+// Return false and write a diagnostic to ERR if STR cannot be
+// parsed.
+static bool parse_ap(const std::string& str,
+                     const tchecker::zg::ta::model_t& model,
+                     one_prop& res, std::ostream& err)
 {
-  int errors = 0;
-  std::ostringstream err;
-
   const auto& sys = model.system();
   const auto& procidx = sys.processes();
-  const auto& locations = sys.locations();
   auto const& intvars = model.system_integer_variables();
   auto const& varsidx = intvars.index();
 
-  for (spot::atomic_prop_set::const_iterator ap = aps->begin();
-       ap != aps->end(); ++ap)
+  const char* s = str.c_str();
+
+  // Skip any leading blank.
+  while (*s && (*s == ' ' || *s == '\t'))
+    ++s;
+  if (!*s)
     {
-      if (*ap == dead)
-        continue;
+      err << "Proposition `" << str << "' cannot be parsed.\n";
+      return false;
+    }
+
 
-      const std::string& str = ap->ap_name();
-      const char* s = str.c_str();
+  char* name = (char*) malloc(str.size() + 1);
+  char* name_p = name;
+  char* lastdot = nullptr;
+  while (*s && (*s != '=') && *s != '<' && *s != '!'  && *s != '>')
+    {
 
-      // Skip any leading blank.
-      while (*s && (*s == ' ' || *s == '\t'))
+      if (*s == ' ' || *s == '\t')
         ++s;
-      if (!*s)
+      else
         {
-          err << "Proposition `" << str << "' cannot be parsed.\n";
-          ++errors;
-          continue;
+          if (*s == '.')
+            lastdot = name_p;
+          *name_p++ = *s++;
         }
+    }
+  *name_p = 0;
 
+  if (name == name_p)
+    {
+      err << "Proposition `" << str << "' cannot be parsed.\n";
+      free(name);
+      return false;
+    }
 
-      char* name = (char*) malloc(str.size() + 1);
-      char* name_p = name;
-      char* lastdot = nullptr;
-      while (*s && (*s != '=') && *s != '<' && *s != '!'  && *s != '>')
-        {
+  // Lookup the name
+  int varid;
+  try
+    {
+      varid = varsidx.key(name);
+    }
+  catch (const std::invalid_argument&)
+    {
+      varid = -1;
+    }
 
-          if (*s == ' ' || *s == '\t')
-            ++s;
-          else
+  if (varid < 0)
+    {
+      // We may have a name such as X.Y.Z
+      // If it is not a known variable, it might mean
+      // an enumerated variable X.Y with value Z.
+      int procid = -1;
+      if (lastdot)
+        {
+          *lastdot++ = 0;
+          try
+            {
+              procid = procidx.key(name);
+            }
+          catch (const std::invalid_argument&)
             {
-              if (*s == '.')
-                lastdot = name_p;
-              *name_p++ = *s++;
+              procid = -1;
             }
         }
-      *name_p = 0;
 
-      if (name == name_p)
+      if (procid < 0)
         {
-          err << "Proposition `" << str << "' cannot be parsed.\n";
+          err << "No variable or process `" << name
+              << "' found in model (for proposition `"
+              << str << "').\n";
           free(name);
-          ++errors;
-          continue;
+          return false;
         }
 
-      // Lookup the name
-      int varid;
+      // We have found a process name, lastdot is
+      // pointing to its location.
       try
         {
-          varid = varsidx.key(name);
+          varid = sys.location(name, lastdot)->id();
         }
       catch (const std::invalid_argument&)
         {
-          varid = -1;
+          err << "No location `" << lastdot << "' known for process `"
+              << name << "'.\n";
+          // FIXME: list possible locations.
+          free(name);
+          return false;
         }
 
-      if (varid < 0)
+      // At this point, *s should be 0.
+      if (*s)
         {
-          // We may have a name such as X.Y.Z
-          // If it is not a known variable, it might mean
-          // an enumerated variable X.Y with value Z.
-          int procid = -1;
-          if (lastdot)
-            {
-              *lastdot++ = 0;
-              try
-                {
-                  procid = procidx.key(name);
-                }
-              catch (const std::invalid_argument&)
-                {
-                  procid = -1;
-                }
-            }
+          err << "Trailing garbage `" << s
+              << "' at end of proposition `"
+              << str << "'.\n";
+          free(name);
+          return false;
+        }
 
-          if (procid < 0)
-            {
-              err << "No variable or process `" << name
-                  << "' found in model (for proposition `"
-                  << str << "').\n";
-              free(name);
-              ++errors;
-              continue;
-            }
+      // Record that X.Y must be equal to Z.
+      res = { procid, OP_AT, varid, -1 };
+      free(name);
+      return true;
+    }
 
-          // We have found a process name, lastdot is
-          // pointing to its location.
-          try
-            {
-              varid = sys.location(name, lastdot)->id();
-            }
-          catch (const std::invalid_argument&)
-            {
-              err << "No location `" << lastdot << "' known for process `"
-                  << name << "'.\n";
-              // FIXME: list possible locations.
-              free(name);
-              ++errors;
-              continue;
-            }
+  if (!*s)                // No operator?  Assume "!= 0".
+    {
+      res = { varid, OP_NE, 0, -1 };
+      free(name);
+      return true;
+    }
 
-          // At this point, *s should be 0.
-          if (*s)
-            {
-              err << "Trailing garbage `" << s
-                  << "' at end of proposition `"
-                  << str << "'.\n";
-              free(name);
-              ++errors;
-              continue;
-            }
+  relop op;
 
-          // Record that X.Y must be equal to Z.
-          int v = dict->register_proposition(*ap, &out);
-          one_prop p = { procid, OP_AT, varid, v };
-          out.emplace_back(p);
-          free(name);
-          continue;
+  switch (*s)
+    {
+    case '!':
+      if (s[1] != '=')
+        goto report_error;
+      op = OP_NE;
+      s += 2;
+      break;
+    case '=':
+      if (s[1] != '=')
+        goto report_error;
+      op = OP_EQ;
+      s += 2;
+      break;
+    case '<':
+      if (s[1] == '=')
+        {
+          op = OP_LE;
+          s += 2;
+        }
+      else
+        {
+          op = OP_LT;
+          ++s;
+        }
+      break;
+    case '>':
+      if (s[1] == '=')
+        {
+          op = OP_GE;
+          s += 2;
         }
+      else
+        {
+          op = OP_GT;
+          ++s;
+        }
+      break;
+    default:
+    report_error:
+      err << "Unexpected `" << s
+          << "' while parsing atomic proposition `" << str
+          << "'.\n";
+      free(name);
+      return false;
+    }
+
+  while (*s && (*s == ' ' || *s == '\t'))
+    ++s;
+
+  char* s_end;
+  int val = strtol(s, &s_end, 10);
+  if (s == s_end)
+    {
+      err << "Failed to parse `" << s << "' as an integer.\n";
+      free(name);
+      return false;
+    }
+  s = s_end;
+  free(name);
+
+  while (*s && (*s == ' ' || *s == '\t'))
+    ++s;
+  if (*s)
+    {
+      err << "Unexpected `" << s
+          << "' while parsing atomic proposition `" << str
+          << "'.\n";
+      return false;
+    }
+
+  res = { varid, op, val, -1 };
+  return true;
+}
+
+// Convert a set of atomic propositions (seen as strings) into a kind
+// of byte-code (prop_list) that encode the associated query.  At some
+// point this service should be offered by TChecker, so that we do not
+// have to depend on the way variables are stored, and so that we do
+// not even have to decide on the syntax to use for those
+// propositions.
+// https://github.com/ticktac-project/tchecker/issues/21
+void convert_aps(const spot::atomic_prop_set* aps,
+                 const tchecker::zg::ta::model_t& model,
+                 spot::bdd_dict_ptr dict, spot::formula dead,
+                 prop_list& out)
+{
+  int errors = 0;
+  std::ostringstream err;
+
+  for (spot::atomic_prop_set::const_iterator ap = aps->begin();
+       ap != aps->end(); ++ap)
+    {
+      if (*ap == dead)
+        continue;
 
-      if (!*s)                // No operator?  Assume "!= 0".
+      one_prop p;
+      if (!parse_ap(ap->ap_name(), model, p, err))
         {
-          int v = dict->register_proposition(*ap, &out);
-          one_prop p = { varid, OP_NE, 0, v };
-          out.emplace_back(p);
-          free(name);
+          ++errors;
           continue;
         }
+      p.bddvar = dict->register_proposition(*ap, &out);
+      out.emplace_back(p);
+    }
+
+  if (errors)
+    throw std::runtime_error(err.str());
+}
 
-      relop op;
+spot::exclusive_ap
+tc_model::exclusive_aps(const spot::atomic_prop_set* aps) const
+{
+  // Propositions OP_AT for each process, and OP_EQ for each
+  // variable, indexed by location or value so that only one
+  // proposition is kept for each (they are then equivalent).
+  std::map<int, std::map<int, spot::formula>> at;
+  std::map<int, std::map<int, spot::formula>> eq;
+  std::ostringstream ignored;
+  for (auto& ap: *aps)
+    {
+      one_prop p;
+      if (!parse_ap(ap.ap_name(), *priv_->model, p, ignored))
+        continue;
+      if (p.op == OP_AT)
+        at[p.var_num].emplace(p.val, ap);
+      else if (p.op == OP_EQ)
+        eq[p.var_num].emplace(p.val, ap);
+    }
 
-      switch (*s)
+  spot::exclusive_ap res;
+  for (auto* groups: {&at, &eq})
+    for (auto& [num, props]: *groups)
+      if (props.size() > 1)
         {
-        case '!':
-          if (s[1] != '=')
-            goto report_error;
-          op = OP_NE;
-          s += 2;
+          std::vector<spot::formula> group;
+          for (auto& [val, f]: props)
+            group.push_back(f);
+          res.add_group(group);
+        }
+  return res;
+}
+
+spot::formula tc_model::normalize_aps(spot::formula f,
+                                      spot::formula dead) const
+{
+  const auto& varsidx = priv_->model->system_integer_variables().index();
+  std::ostringstream ignored;
+  std::function<spot::formula(spot::formula)> rec =
+    [&](spot::formula f) -> spot::formula
+    {
+      if (!f.is(spot::op::ap))
+        return f.map(rec);
+      one_prop p;
+      if (f == dead || !parse_ap(f.ap_name(), *priv_->model, p, ignored)
+          || p.op == OP_AT)
+        return f;
+      // Over integers, x<v is x<=v-1, and x>=v is !(x<=v-1).  There
+      // is no v-1 for the smallest int, so such comparisons are kept.
+      if ((p.op == OP_LT || p.op == OP_GE) && p.val == INT_MIN)
+        return f;
+      bool neg = false;
+      switch (p.op)
+        {
+        case OP_EQ:
+        case OP_LE:
           break;
-        case '=':
-          if (s[1] != '=')
-            goto report_error;
-          op = OP_EQ;
-          s += 2;
+        case OP_NE:
+          neg = true;
+          p.op = OP_EQ;
           break;
-        case '<':
-          if (s[1] == '=')
-            {
-              op = OP_LE;
-              s += 2;
-            }
-          else
-            {
-              op = OP_LT;
-              ++s;
-            }
+        case OP_GT:
+          neg = true;
+          p.op = OP_LE;
           break;
-        case '>':
-          if (s[1] == '=')
-            {
-              op = OP_GE;
-              s += 2;
-            }
-          else
-            {
-              op = OP_GT;
-              ++s;
-            }
+        case OP_LT:
+          --p.val;
+          p.op = OP_LE;
+          break;
+        case OP_GE:
+          --p.val;
+          neg = true;
+          p.op = OP_LE;
+          break;
+        case OP_AT:
+          // unreachable
           break;
-        default:
-        report_error:
-          err << "Unexpected `" << s
-              << "' while parsing atomic proposition `" << str
-              << "'.\n";
-          ++errors;
-          free(name);
-          continue;
         }
+      std::string name = varsidx.value(p.var_num);
+      name += p.op == OP_EQ ? "==" : "<=";
+      name += std::to_string(p.val);
+      spot::formula res = spot::formula::ap(name);
+      return neg ? spot::formula::Not(res) : res;
+    };
+  return rec(f);
+}
 
-      while (*s && (*s == ' ' || *s == '\t'))
-        ++s;
+tc_model tc_model::untimed_abstraction(bool stutter,
+                                      const std::set<std::string>& keep)
+  const
+{
+  tc_declarations decls = tc_parse_declarations(priv_->get_source());
+  if (stutter)
+    for (auto& l: tc_model_info(decls).locations)
+      if (l.committed)
+        throw std::runtime_error("location " + l.process + "." + l.name
+                                 + " is committed, so the untimed "
+                                 "abstraction cannot stutter");
+  return load_from_string(tc_untimed_model(decls, stutter, keep));
+}
 
-      char* s_end;
-      int val = strtol(s, &s_end, 10);
-      if (s == s_end)
-        {
-          err << "Failed to parse `" << s << "' as an integer.\n";
-          ++errors;
-          free(name);
-          continue;
-        }
-      s = s_end;
-      free(name);
+tc_model tc_model::digital_model() const
+{
+  return load_from_string
+    (tc_digital_model(tc_parse_declarations(priv_->get_source())));
+}
+
+namespace
+{
+  // The locations and integer values of a state, by name.
+  struct discrete_state
+  {
+    std::map<std::string, std::string> locations;
+    std::map<std::string, int> intvars;
+  };
+
+  discrete_state get_discrete_state(const tc_kripke& k, const spot::state* s)
+  {
+    discrete_state res;
+    for (auto& [proc, loc]: k.locations(s))
+      res.locations.emplace(proc, loc);
+    for (auto& [var, val]: k.intvars(s))
+      res.intvars.emplace(var, val);
+    return res;
+  }
+
+  // Whether the state S of K has the locations and integer values of
+  // D.  Processes of D that K does not have (like the process added
+  // by tc_untimed_model() to stutter) are ignored.
+  bool matches(const tc_kripke& k, const spot::state* s,
+               const discrete_state& d)
+  {
+    for (auto& [proc, loc]: k.locations(s))
+      if (auto it = d.locations.find(proc);
+          it == d.locations.end() || it->second != loc)
+        return false;
+    for (auto& [var, val]: k.intvars(s))
+      if (auto it = d.intvars.find(var);
+          it == d.intvars.end() || it->second != val)
+        return false;
+    return true;
+  }
+
+  // Try to follow PATH on K, where PATH[CYCLE..] is repeated forever
+  // (PATH is finite if CYCLE == PATH.size()).  The states of K that
+  // match each step of PATH are computed as the successors of those
+  // of the previous step, and the cycle is followed until the set of
+  // states at its start is one that was already seen.  Return the
+  // number of steps of PATH (counting each step again when the cycle
+  // is repeated) whose state is reached before the set of states
+  // becomes empty, or -1 if PATH can be followed entirely.
+  unsigned replay(const tc_kripke& k,
+                  const std::vector<discrete_state>& path, size_t cycle)
+  {
+    // All the states built, to release them at the end.
+    std::vector<const spot::state*> owned;
+    auto same = [](const spot::state_set& a, const spot::state_set& b)
+      {
+        if (a.size() != b.size())
+          return false;
+        for (auto* s: a)
+          if (!b.count(s))
+            return false;
+        return true;
+      };
+
+    spot::state_set cur;
+    const spot::state* init = k.get_init_state();
+    owned.push_back(init);
+    if (matches(k, init, path[0]))
+      cur.insert(init);
+    std::vector<spot::state_set> seen;
+    unsigned res = 0;
+    size_t n = path.size();
+    for (size_t i = 0; !cur.empty(); )
+      {
+        ++res;
+        if (i == cycle)
+          {
+            if (std::any_of(seen.begin(), seen.end(),
+                            [&](auto& s) { return same(s, cur); }))
+              {
+                res = -1;
+                break;
+              }
+            seen.push_back(cur);
+          }
+        if (++i == n)
+          {
+            if (cycle == n)
+              {
+                res = -1;
+                break;
+              }
+            i = cycle;
+          }
+        spot::state_set next;
+        for (auto* s: cur)
+          {
+            auto* it = k.succ_iter(s);
+            for (it->first(); !it->done(); it->next())
+              {
+                const spot::state* d = it->dst();
+                owned.push_back(d);
+                if (matches(k, d, path[i]))
+                  next.insert(d);
+              }
+            k.release_iter(it);
+          }
+        cur.swap(next);
+      }
+    for (auto* s: owned)
+      s->destroy();
+    return res;
+  }
+}
 
-      while (*s && (*s == ' ' || *s == '\t'))
-        ++s;
-      if (*s)
+std::set<std::string>
+tc_model::refine_clocks(const spot::twa_run& run,
+                        const std::set<std::string>& kept,
+                        spot::formula dead) const
+{
+  auto k = std::dynamic_pointer_cast<const tc_kripke>(run.aut);
+  if (!k)
+    return {};
+  std::vector<discrete_state> path;
+  for (auto* steps: {&run.prefix, &run.cycle})
+    for (auto& step: *steps)
+      path.push_back(get_discrete_state(*k, step.s));
+  size_t cycle = run.prefix.size();
+  if (run.cycle.empty())
+    cycle = path.size();
+
+  // How much of PATH can be followed on M (this model or one of its
+  // abstractions).  Any extrapolation that keeps the zone graph finite
+  // would do, since zone graphs preserve the feasibility of finite
+  // paths.
+  spot::atomic_prop_set no_aps;
+  auto dict = spot::make_bdd_dict();
+  auto follows = [&](tc_model m)
+    {
+      auto mk = m.kripke(&no_aps, dict, dead, elapsed_extraLUplus_local);
+      return replay(*std::static_pointer_cast<const tc_kripke>(mk),
+                    path, cycle);
+    };
+  unsigned followed = follows(*this);
+  if (followed == -1U)
+    return {};
+
+  // The clocks that can make the steps followed, and the next one,
+  // infeasible: those of the invariants of the locations visited, and
+  // of the guards of the edges between them.
+  tc_model_info info(tc_parse_declarations(priv_->get_source()));
+  std::map<tc_location_name, std::set<std::string>> inv;
+  for (auto& l: info.locations)
+    inv[{l.process, l.name}].insert(l.clocks.begin(), l.clocks.end());
+  std::map<std::pair<tc_location_name, std::string>,
+           std::set<std::string>> guards;
+  for (auto& e: info.edges)
+    guards[{{e.process, e.src}, e.tgt}].insert(e.clock_guards.begin(),
+                                               e.clock_guards.end());
+  std::set<std::string> cand;
+  // The clocks of the first infeasible step.
+  std::set<std::string> last;
+  auto add = [&](const std::set<std::string>& clocks, bool is_last)
+    {
+      for (auto& c: clocks)
+        if (!kept.count(c))
+          {
+            cand.insert(c);
+            if (is_last)
+              last.insert(c);
+          }
+    };
+  size_t n = path.size();
+  size_t i = 0;
+  for (unsigned step = 0; step < followed; ++step)
+    {
+      size_t j = i + 1 == n ? cycle : i + 1;
+      bool is_last = step + 1 == followed;
+      for (auto& [proc, loc]: path[i].locations)
         {
-          err << "Unexpected `" << s
-              << "' while parsing atomic proposition `" << str
-              << "'.\n";
-          ++errors;
-          continue;
+          if (auto it = inv.find({proc, loc}); it != inv.end())
+            add(it->second, is_last);
+          auto it = guards.find({{proc, loc}, path[j].locations[proc]});
+          if (it != guards.end())
+            add(it->second, is_last);
         }
-
-      int v = dict->register_proposition(*ap, &out);
-      one_prop p = { varid, op, val, v };
-      out.emplace_back(p);
+      i = j;
     }
-
-  if (errors)
-    throw std::runtime_error(err.str());
+  for (auto& [proc, loc]: path[i].locations)
+    if (auto it = inv.find({proc, loc}); it != inv.end())
+      add(it->second, true);
+
+  // Remove the clocks that are not needed to make PATH infeasible,
+  // trying first those that do not appear on its infeasible step.
+  // If the candidates are not enough (e.g., because the clocks that
+  // matter were reset on a previous visit of the cycle), start from
+  // all the clocks of the model.
+  auto infeasible = [&](const std::set<std::string>& clocks)
+    {
+      std::set<std::string> keep = kept;
+      keep.insert(clocks.begin(), clocks.end());
+      return follows(untimed_abstraction(false, keep)) != -1U;
+    };
+  if (!infeasible(cand))
+    for (auto& d: tc_parse_declarations(priv_->get_source()))
+      if (d.kind() == "clock" && d.fields.size() > 2)
+        add({d.fields[2]}, false);
+  std::vector<std::string> order(cand.begin(), cand.end());
+  std::stable_partition(order.begin(), order.end(),
+                        [&](const std::string& c)
+                        {
+                          return !last.count(c);
+                        });
+  for (auto& c: order)
+    {
+      cand.erase(c);
+      if (!infeasible(cand))
+        cand.insert(c);
+    }
+  return cand;
 }
 
-tc_model::tc_model(tc_model_details* tcm)
-  : priv_(tcm)
+tc_model::tc_model(tc_model_details_ptr tcm)
+  : priv_(tcm), logs_(tcm->load_logs)
 {
 }
 
-tc_model tc_model::load(const std::string filename)
+// TChecker's parser relies on global variables, so we only allow
+// one model to be parsed and instantiated at a time.
+static std::mutex load_mutex;
+
+// Parse and instantiate the model in FILENAME.
+static tc_model_details_ptr parse_model(const std::string& filename)
 {
-  auto tcm = std::make_unique<tc_model_details>();
+  auto tcm = std::make_shared<tc_model_details>();
 
+  std::lock_guard<std::mutex> lock(load_mutex);
   auto* sysdecl =
     tchecker::parsing::parse_system_declaration(filename, tcm->log);
 
@@ -742,12 +2572,224 @@ tc_model tc_model::load(const std::string filename)
 
   tcm->sysdecl = sysdecl;
   tcm->model = new tchecker::zg::ta::model_t(*sysdecl, tcm->log);
-  return tc_model(tcm.release());
+  tcm->load_logs = tcm->get_logs();
+  const auto& sys = tcm->model->system();
+  tcm->loc_preds.resize(sys.locations().size());
+  for (const auto* e: sys.edges())
+    tcm->loc_preds[e->tgt()->id()].push_back(e->src()->id());
+  return tcm;
+}
+
+// Read the entire contents of FILENAME, and store its status in ST.
+static std::string read_file(const std::string& filename, struct stat& st)
+{
+  FILE* f = fopen(filename.c_str(), "r");
+  if (!f)
+    throw std::runtime_error("cannot open " + filename + ": "
+                             + strerror(errno));
+  if (fstat(fileno(f), &st) != 0)
+    {
+      int saved_errno = errno;
+      fclose(f);
+      throw std::runtime_error("cannot stat " + filename + ": "
+                               + strerror(saved_errno));
+    }
+  std::string res;
+  char buf[BUFSIZ];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof buf, f)) > 0)
+    res.append(buf, n);
+  int saved_errno = errno;
+  bool err = ferror(f);
+  fclose(f);
+  if (err)
+    throw std::runtime_error("cannot read " + filename + ": "
+                             + strerror(saved_errno));
+  return res;
+}
+
+const std::string& tc_model_details::get_source() const
+{
+  std::call_once(source_once, [this]()
+    {
+      if (filename.empty())
+        return;
+      struct stat st;
+      std::string text = read_file(filename, st);
+      if (st.st_dev != file_stat.st_dev || st.st_ino != file_stat.st_ino
+          || st.st_size != file_stat.st_size
+          || st.st_mtime != file_stat.st_mtime)
+        throw std::runtime_error(filename + " has changed since it was "
+                                 "loaded");
+      source = std::move(text);
+    });
+  return source;
+}
+
+tc_model tc_model::load(const std::string filename)
+{
+  // Remember the status of the file, so that get_source() can tell
+  // whether it still holds the text that TChecker parsed.
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0)
+    throw std::runtime_error("cannot open " + filename + ": "
+                             + strerror(errno));
+  auto tcm = parse_model(filename);
+  tcm->filename = filename;
+  tcm->file_stat = st;
+  return tc_model(tcm);
+}
+
+// Write all of TEXT to FD.  Return false on error, with errno set.
+static bool write_all(int fd, const std::string& text)
+{
+  const char* buf = text.data();
+  size_t left = text.size();
+  while (left > 0)
+    {
+      ssize_t n = write(fd, buf, left);
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return false;
+        }
+      buf += n;
+      left -= n;
+    }
+  return true;
+}
+
+// TChecker can only parse files, so load_from_string() has to give it
+// a file containing MODEL.
+static tc_model_details_ptr parse_model_text(const std::string& model)
+{
+#if HAVE_MEMFD_CREATE
+  // Keep the text in memory, and let TChecker open it through
+  // /proc.  The memory is released once the descriptor is closed.
+  int fd = memfd_create("tcltl-model", MFD_CLOEXEC);
+  std::string path = "/proc/self/fd/" + std::to_string(fd);
+  if (fd >= 0 && access(path.c_str(), R_OK) != 0)
+    {
+      close(fd);
+      fd = -1;
+    }
+  if (fd >= 0)
+    {
+      if (!write_all(fd, model))
+        {
+          int saved_errno = errno;
+          close(fd);
+          throw std::runtime_error(std::string("cannot write model: ")
+                                   + strerror(saved_errno));
+        }
+      try
+        {
+          auto res = parse_model(path);
+          close(fd);
+          return res;
+        }
+      catch (...)
+        {
+          close(fd);
+          throw;
+        }
+    }
+  // If memfd_create() is not supported by the kernel, or if /proc is
+  // not mounted, fall back to a temporary file.
+#endif
+
+  const char* tmpdir = getenv("TMPDIR");
+  std::string name = std::string(tmpdir ? tmpdir : "/tmp")
+    + "/tcltl-XXXXXX";
+  int tfd = mkstemp(&name[0]);
+  if (tfd < 0)
+    throw std::runtime_error("cannot create " + name + ": "
+                             + strerror(errno));
+  bool ok = write_all(tfd, model);
+  int saved_errno = errno;
+  if (close(tfd) != 0 && ok)
+    {
+      ok = false;
+      saved_errno = errno;
+    }
+  if (!ok)
+    {
+      unlink(name.c_str());
+      throw std::runtime_error("cannot write " + name + ": "
+                               + strerror(saved_errno));
+    }
+  try
+    {
+      auto res = parse_model(name);
+      unlink(name.c_str());
+      return res;
+    }
+  catch (...)
+    {
+      unlink(name.c_str());
+      throw;
+    }
+}
+
+tc_model tc_model::load_from_string(const std::string& text)
+{
+  // TChecker requires the last line to be terminated.  See
+  // ticktac-project/tchecker#35.
+  std::string model = text;
+  if (model.empty() || model.back() != '\n')
+    model += '\n';
+  auto tcm = parse_model_text(model);
+  tcm->source = std::move(model);
+  return tc_model(tcm);
 }
 
 std::string tc_model::get_logs() const
 {
-  return priv_->get_logs();
+  std::string res = logs_ + priv_->get_logs();
+  logs_.clear();
+  return res;
+}
+
+void print_timed_run(std::ostream& out, const tc_timed_run& r)
+{
+  auto print_steps = [&](const std::vector<tc_timed_step>& steps)
+    {
+      out << '[';
+      const char* sep = "";
+      for (auto& step: steps)
+        {
+          out << sep << "{\"locations\":{";
+          const char* lsep = "";
+          for (auto& [proc, loc]: step.locations)
+            {
+              out << lsep << '"' << proc << "\":\"" << loc << '"';
+              lsep = ",";
+            }
+          out << "},\"clocks\":[";
+          const char* csep = "";
+          for (auto v: step.clocks)
+            {
+              out << csep << v;
+              csep = ",";
+            }
+          out << "],\"delay\":" << step.delay << '}';
+          sep = ",";
+        }
+      out << ']';
+    };
+  out << "{\"clocks\":[";
+  const char* sep = "";
+  for (auto& c: r.clocks)
+    {
+      out << sep << '"' << c << '"';
+      sep = ",";
+    }
+  out << "],\"denominator\":" << r.denominator << ",\"prefix\":";
+  print_steps(r.prefix);
+  out << ",\"cycle\":";
+  print_steps(r.cycle);
+  out << ",\"repeatable\":" << (r.repeatable ? "true" : "false") << '}';
 }
 
 void tc_model::dump_info(std::ostream& out) const
@@ -790,12 +2832,13 @@ void tc_model::dump_info(std::ostream& out) const
 static spot::kripke_ptr
 instantiate_kripke(tc_model_details_ptr tcmd,
                    const spot::bdd_dict_ptr& dict, const prop_list* ps,
-                   spot::formula dead, zg_zone_semantics zone_sem)
+                   spot::formula dead, zg_zone_semantics zone_sem,
+                   unsigned opts)
 {
 #define inst(ZONE) \
   case ZONE: \
     return std::make_shared<tcltl_kripke<tchecker::zg::ta::ZONE ## _t>>\
-      (tcmd, dict, ps, dead);
+      (tcmd, dict, ps, dead, opts);
   switch (zone_sem)
     {
       inst(elapsed_no_extrapolation);
@@ -816,6 +2859,9 @@ instantiate_kripke(tc_model_details_ptr tcmd,
       inst(non_elapsed_extraM_local);
       inst(non_elapsed_extraMplus_global);
       inst(non_elapsed_extraMplus_local);
+    case digital:
+      // Handled by tc_model::kripke().
+      break;
     }
 #undef inst
   // unreachable
@@ -826,8 +2872,18 @@ instantiate_kripke(tc_model_details_ptr tcmd,
 spot::kripke_ptr tc_model::kripke(const spot::atomic_prop_set* to_observe,
                                   spot::bdd_dict_ptr dict,
                                   spot::formula dead,
-                                  zg_zone_semantics zone_sem)
+                                  zg_zone_semantics zone_sem,
+                                  unsigned opts)
 {
+  if (zone_sem == digital)
+    {
+      if (opts & kripke_non_zeno)
+        throw std::runtime_error("kripke_non_zeno is not supported with "
+                                 "the digital semantics");
+      return digital_model().kripke(to_observe, dict, dead,
+                                    non_elapsed_no_extrapolation, opts);
+    }
+
   prop_list* ps = new prop_list;
   try
     {
@@ -841,7 +2897,7 @@ spot::kripke_ptr tc_model::kripke(const spot::atomic_prop_set* to_observe,
     }
 
   spot::kripke_ptr res =
-    instantiate_kripke(priv_, dict, ps, dead, zone_sem);
+    instantiate_kripke(priv_, dict, ps, dead, zone_sem, opts);
 
   // All atomic propositions have been registered to the bdd_dict
   // for iface, but we also need to add them to the automaton so
@@ -852,3 +2908,614 @@ spot::kripke_ptr tc_model::kripke(const spot::atomic_prop_set* to_observe,
     res->register_ap(dead);
   return res;
 }
+
+// Breadth-first exploration of the zone graph for tc_model::explore().
+// This uses TChecker's builder directly (with the same allocators as
+// tcltl_kripke) rather than going through a Kripke structure, so
+// that no BDD has to be computed.
+template <typename ZONE>
+static void
+explore_zg(const tc_model_details& tcmd, tc_state_space& out)
+{
+  using kripke_t = tcltl_kripke<ZONE>;
+  using state_ptr_t = typename kripke_t::state_ptr_t;
+
+  struct state_hash
+  {
+    size_t operator()(const state_ptr_t& s) const
+    {
+      return hash_value(*s);
+    }
+  };
+  struct state_equal
+  {
+    bool operator()(const state_ptr_t& a, const state_ptr_t& b) const
+    {
+      return *a == *b;
+    }
+  };
+
+  tchecker::gc_t unused_gc;
+  typename ZONE::ts_t ts(*tcmd.model);
+  typename kripke_t::allocator_t
+    allocator(unused_gc, std::make_tuple(*tcmd.model, 100000),
+              std::tuple<>());
+  typename kripke_t::builder_t builder(ts, allocator);
+  // Declared after the allocator, so that states are released
+  // before the allocator is destroyed.
+  std::unordered_map<state_ptr_t, unsigned,
+                     state_hash, state_equal> seen;
+  std::vector<state_ptr_t> todo;
+
+  auto number = [&](const state_ptr_t& st) -> unsigned
+    {
+      auto [it, inserted] = seen.emplace(st, out.num_states);
+      if (!inserted)
+        return it->second;
+      todo.push_back(st);
+      auto& vloc = st->vloc();
+      for (unsigned p = 0; p < out.num_processes; ++p)
+        out.locations.push_back(vloc[p]->id());
+      auto& vals = st->intvars_valuation();
+      for (unsigned v = 0; v < out.num_intvars; ++v)
+        out.intvars.push_back(vals[v]);
+      return out.num_states++;
+    };
+
+  auto initial_range = builder.initial();
+  for (auto it = initial_range.begin(); !it.at_end(); ++it)
+    number(std::get<0>(*it));
+  out.num_initial = out.num_states;
+
+  // TODO is used as a FIFO: state number s is todo[s].
+  for (unsigned s = 0; s < todo.size(); ++s)
+    {
+      out.offsets.push_back(out.succ.size());
+      state_ptr_t st = todo[s];
+      auto range = builder.outgoing(st);
+      for (auto it = range.begin(); !it.at_end(); ++it)
+        out.succ.push_back(number(std::get<0>(*it)));
+    }
+  out.offsets.push_back(out.succ.size());
+  todo.clear();
+  seen.clear();
+}
+
+tc_state_space_ptr tc_model::explore(zg_zone_semantics zone_sem) const
+{
+  if (zone_sem == digital)
+    return digital_model().explore(non_elapsed_no_extrapolation);
+  auto res = std::make_shared<tc_state_space>();
+  res->num_processes = priv_->model->system().processes_count();
+  res->num_intvars =
+    priv_->model->system_integer_variables().index().size();
+#define inst(ZONE) \
+  case ZONE: \
+    explore_zg<tchecker::zg::ta::ZONE ## _t>(*priv_, *res); \
+    break;
+  switch (zone_sem)
+    {
+      inst(elapsed_no_extrapolation);
+      inst(elapsed_extraLU_global);
+      inst(elapsed_extraLU_local);
+      inst(elapsed_extraLUplus_global);
+      inst(elapsed_extraLUplus_local);
+      inst(elapsed_extraM_global);
+      inst(elapsed_extraM_local);
+      inst(elapsed_extraMplus_global);
+      inst(elapsed_extraMplus_local);
+      inst(non_elapsed_no_extrapolation);
+      inst(non_elapsed_extraLU_global);
+      inst(non_elapsed_extraLU_local);
+      inst(non_elapsed_extraLUplus_global);
+      inst(non_elapsed_extraLUplus_local);
+      inst(non_elapsed_extraM_global);
+      inst(non_elapsed_extraM_local);
+      inst(non_elapsed_extraMplus_global);
+      inst(non_elapsed_extraMplus_local);
+    case digital:
+      // Handled above.
+      break;
+    }
+#undef inst
+  return res;
+}
+
+// The value a + b*d of a clock after a delay d, in the random walks
+// of tc_model::simulate(): b is 0 for clocks that were reset by the
+// transition, and 1 otherwise.
+struct sim_clock
+{
+  double a;
+  int b;
+};
+
+// The delays d after which some clock constraints hold, given the
+// values of the clocks after d (see sim_clock).  They form an
+// interval whose bounds may be strict, and whose upper bound may be
+// missing.
+struct sim_delays
+{
+  double lo = 0;
+  bool lo_strict = false;
+  double hi = 0;
+  bool hi_strict = false;
+  bool bounded = false;
+  bool infeasible = false;
+
+  void constrain(const tchecker::clock_constraint_container_t& cs,
+                 const std::vector<sim_clock>& vals)
+  {
+    for (auto& cc: cs)
+      {
+        // x - y < c (or <=) becomes a + b*d < c.
+        sim_clock x{0, 0};
+        sim_clock y{0, 0};
+        if (cc.id1() != tchecker::REFCLOCK_ID)
+          x = vals[cc.id1()];
+        if (cc.id2() != tchecker::REFCLOCK_ID)
+          y = vals[cc.id2()];
+        double a = x.a - y.a;
+        int b = x.b - y.b;
+        double c = cc.value();
+        bool strict = cc.comparator() == tchecker::clock_constraint_t::LT;
+        if (b == 0)
+          {
+            infeasible |= a > c || (a == c && strict);
+          }
+        else if (b > 0)
+          {
+            if (!bounded || c - a < hi || (c - a == hi && strict))
+              {
+                hi = c - a;
+                hi_strict = strict;
+                bounded = true;
+              }
+          }
+        else if (a - c > lo || (a - c == lo && strict))
+          {
+            lo = a - c;
+            lo_strict = strict;
+          }
+      }
+  }
+
+  bool empty() const
+  {
+    return infeasible
+      || (bounded && (lo > hi || (lo == hi && (lo_strict || hi_strict))));
+  }
+
+  // Pick a delay of the interval, uniformly if it is bounded, and
+  // otherwise by adding to its lower bound a delay that follows an
+  // exponential distribution of mean 1.
+  template <typename RNG>
+  double pick(RNG& rng) const
+  {
+    if (!bounded)
+      return lo + std::exponential_distribution<double>(1.0)(rng);
+    if (lo == hi)
+      return lo;
+    double d = std::uniform_real_distribution<double>(lo, hi)(rng);
+    if (lo_strict && d == lo)
+      d = (lo + hi) / 2;
+    return d;
+  }
+};
+
+// Random walks for tc_model::simulate(): walks FIRST, FIRST + STRIDE,
+// ... (below RUNS) are added to OUT.  Like explore_zg(), this uses
+// TChecker's builder directly, to compute the discrete successors of
+// each state, but the walks follow concrete clock values: from a
+// state and clock values v, a transition can be taken after a delay
+// d if v + d satisfies the invariant of the state and the guard of
+// the transition, and the clock values after its resets satisfy the
+// invariant of its target.  Each step picks one of the transitions
+// that can be taken for some d, uniformly, and then d.
+template <typename ZONE>
+static void
+simulate_zg(const tc_model_details& tcmd, const prop_list& props,
+            uint64_t first, uint64_t stride, uint64_t runs, unsigned steps,
+            uint64_t seed, tc_simulation& out)
+{
+  using kripke_t = tcltl_kripke<ZONE>;
+  using state_ptr_t = typename kripke_t::state_ptr_t;
+
+  tchecker::gc_t unused_gc;
+  typename ZONE::ts_t ts(*tcmd.model);
+  typename kripke_t::allocator_t
+    allocator(unused_gc, std::make_tuple(*tcmd.model, 100000),
+              std::tuple<>());
+  typename kripke_t::builder_t builder(ts, allocator);
+  // States that are no longer used, but may still be referenced by
+  // TChecker's iterators (see tcltl_kripke::deallocate_state()).
+  // Declared after the allocator, so that states are released before
+  // the allocator is destroyed.
+  std::deque<state_ptr_t> tofree;
+  auto release = [&](state_ptr_t& st)
+    {
+      tofree.push_back(std::move(st));
+      while (!tofree.empty() && tofree.front().refcount() == 1)
+        {
+          bool res = allocator.destruct_state(tofree.front());
+          assert(res); (void) res;
+          tofree.pop_front();
+        }
+    };
+
+  unsigned np = props.size();
+  std::vector<bool> held(np);
+  unsigned nclocks = tcmd.model->flattened_clock_variables().size();
+  // The values of the clocks in the current state, and in the next
+  // one.
+  std::vector<double> clocks(nclocks);
+  std::vector<double> next_clocks(nclocks);
+  std::vector<sim_clock> before(nclocks);
+  std::vector<sim_clock> after(nclocks);
+  for (uint64_t r = first; r < runs; r += stride)
+    {
+      std::mt19937_64 rng(seed + r);
+      // Pick one state among those of RANGE that can be reached from
+      // CLOCKS after some delay, uniformly, and set NEXT_CLOCKS to the
+      // values of the clocks in that state, after a delay picked at
+      // random.  Return the number of states that could be picked.
+      auto pick = [&](auto range, state_ptr_t& res)
+        {
+          for (unsigned x = 0; x < nclocks; ++x)
+            before[x] = {clocks[x], 1};
+          uint64_t n = 0;
+          for (auto it = range.begin(); !it.at_end(); ++it)
+            {
+              auto [st, t] = *it;
+              sim_delays delays;
+              delays.constrain(t->src_invariant_container(), before);
+              delays.constrain(t->guard_container(), before);
+              after = before;
+              for (auto& rs: t->reset_container())
+                if (rs.right_id() == tchecker::REFCLOCK_ID)
+                  after[rs.left_id()] = {double(rs.value()), 0};
+                else
+                  after[rs.left_id()] = {after[rs.right_id()].a + rs.value(),
+                                         after[rs.right_id()].b};
+              delays.constrain(t->tgt_invariant_container(), after);
+              if (!delays.empty()
+                  && std::uniform_int_distribution<uint64_t>(0, n++)(rng) == 0)
+                {
+                  std::swap(st, res);
+                  double d = delays.pick(rng);
+                  for (unsigned x = 0; x < nclocks; ++x)
+                    next_clocks[x] = after[x].a + after[x].b * d;
+                }
+              if (st)
+                release(st);
+            }
+          return n;
+        };
+
+      state_ptr_t cur;
+      // All clocks start at 0.
+      clocks.assign(nclocks, 0);
+      pick(builder.initial(), cur);
+      if (!cur)
+        continue;
+      clocks.swap(next_clocks);
+      ++out.runs;
+      held.assign(np, false);
+      for (unsigned step = 0;; ++step)
+        {
+          auto& vloc = cur->vloc();
+          auto& vals = cur->intvars_valuation();
+          for (unsigned i = 0; i < np; ++i)
+            if (kripke_t::eval_prop(props[i], vloc, vals))
+              {
+                ++out.states_holding[i];
+                held[i] = true;
+              }
+          if (step == steps)
+            break;
+          state_ptr_t next;
+          if (!pick(builder.outgoing(cur), next))
+            {
+              ++out.deadlocks;
+              break;
+            }
+          ++out.steps;
+          release(cur);
+          cur = std::move(next);
+          clocks.swap(next_clocks);
+        }
+      release(cur);
+      for (unsigned i = 0; i < np; ++i)
+        out.runs_holding[i] += held[i];
+    }
+}
+
+tc_simulation tc_model::simulate(const std::vector<std::string>& props,
+                                 uint64_t runs, unsigned steps,
+                                 uint64_t seed, unsigned threads,
+                                 zg_zone_semantics zone_sem) const
+{
+  if (zone_sem == digital)
+    return digital_model().simulate(props, runs, steps, seed, threads,
+                                    non_elapsed_no_extrapolation);
+
+  prop_list ps;
+  std::ostringstream err;
+  for (auto& name: props)
+    if (one_prop p; parse_ap(name, *priv_->model, p, err))
+      ps.push_back(p);
+  if (!err.str().empty())
+    throw std::runtime_error(err.str());
+
+  threads = std::max(1U, threads);
+  std::vector<tc_simulation> res(threads);
+  for (auto& r: res)
+    {
+      r.runs_holding.resize(ps.size());
+      r.states_holding.resize(ps.size());
+    }
+  auto work = [&](unsigned t)
+    {
+      switch (zone_sem)
+        {
+#define inst(ZONE) \
+        case ZONE: \
+          simulate_zg<tchecker::zg::ta::ZONE ## _t> \
+            (*priv_, ps, t, threads, runs, steps, seed, res[t]); \
+          break;
+          inst(elapsed_no_extrapolation);
+          inst(elapsed_extraLU_global);
+          inst(elapsed_extraLU_local);
+          inst(elapsed_extraLUplus_global);
+          inst(elapsed_extraLUplus_local);
+          inst(elapsed_extraM_global);
+          inst(elapsed_extraM_local);
+          inst(elapsed_extraMplus_global);
+          inst(elapsed_extraMplus_local);
+          inst(non_elapsed_no_extrapolation);
+          inst(non_elapsed_extraLU_global);
+          inst(non_elapsed_extraLU_local);
+          inst(non_elapsed_extraLUplus_global);
+          inst(non_elapsed_extraLUplus_local);
+          inst(non_elapsed_extraM_global);
+          inst(non_elapsed_extraM_local);
+          inst(non_elapsed_extraMplus_global);
+          inst(non_elapsed_extraMplus_local);
+#undef inst
+        case digital:
+          // Handled above.
+          break;
+        }
+    };
+  std::vector<std::thread> workers;
+  for (unsigned t = 1; t < threads; ++t)
+    workers.emplace_back(work, t);
+  work(0);
+  for (auto& w: workers)
+    w.join();
+
+  tc_simulation& sum = res[0];
+  for (unsigned t = 1; t < threads; ++t)
+    {
+      sum.runs += res[t].runs;
+      sum.steps += res[t].steps;
+      sum.deadlocks += res[t].deadlocks;
+      for (unsigned i = 0, n = ps.size(); i < n; ++i)
+        {
+          sum.runs_holding[i] += res[t].runs_holding[i];
+          sum.states_holding[i] += res[t].states_holding[i];
+        }
+    }
+  return sum;
+}
+
+// Evaluate the Boolean formula F on ST, for hull_reachable_zg().
+// PROPS maps the atomic propositions of F to their parsed form.
+template <typename KRIPKE, typename STATE>
+static bool
+eval_boolean(const spot::formula& f,
+             const std::map<spot::formula, one_prop>& props,
+             const STATE& st)
+{
+  auto eval = [&](const spot::formula& g)
+    {
+      return eval_boolean<KRIPKE>(g, props, st);
+    };
+  switch (f.kind())
+    {
+    case spot::op::tt:
+      return true;
+    case spot::op::ff:
+      return false;
+    case spot::op::ap:
+      return KRIPKE::eval_prop(props.at(f), st.vloc(),
+                               st.intvars_valuation());
+    case spot::op::Not:
+      return !eval(f[0]);
+    case spot::op::And:
+      for (unsigned i = 0, n = f.size(); i < n; ++i)
+        if (!eval(f[i]))
+          return false;
+      return true;
+    case spot::op::Or:
+      for (unsigned i = 0, n = f.size(); i < n; ++i)
+        if (eval(f[i]))
+          return true;
+      return false;
+    case spot::op::Implies:
+      return !eval(f[0]) || eval(f[1]);
+    case spot::op::Equiv:
+      return eval(f[0]) == eval(f[1]);
+    case spot::op::Xor:
+      return eval(f[0]) != eval(f[1]);
+    default:
+      throw std::runtime_error("unexpected operator in Boolean formula");
+    }
+}
+
+// Reachability of BAD in the convex-hull abstraction of the zone
+// graph, for tc_model::hull_reachable().  States are identified by
+// their discrete part, and each one keeps the convex hull of all the
+// zones reached with that discrete part.  Since the DBMs built by
+// TChecker are tight, their hull is just the entrywise maximum of
+// their bounds, and it is tight as well.  A state is explored again
+// whenever its hull grows.
+template <typename ZONE>
+static bool
+hull_reachable_zg(const tc_model_details& tcmd, const spot::formula& bad,
+                  const std::map<spot::formula, one_prop>& props)
+{
+  using kripke_t = tcltl_kripke<ZONE>;
+  using state_ptr_t = typename kripke_t::state_ptr_t;
+
+  struct discrete_hash
+  {
+    size_t operator()(const state_ptr_t& s) const
+    {
+      size_t h = 0;
+      auto& vloc = s->vloc();
+      for (unsigned p = 0, n = vloc.size(); p < n; ++p)
+        h = h * 31 + vloc[p]->id();
+      auto& vals = s->intvars_valuation();
+      for (unsigned v = 0, n = vals.size(); v < n; ++v)
+        h = h * 31 + vals[v];
+      return h;
+    }
+  };
+  struct discrete_equal
+  {
+    bool operator()(const state_ptr_t& a, const state_ptr_t& b) const
+    {
+      auto& la = a->vloc();
+      auto& lb = b->vloc();
+      for (unsigned p = 0, n = la.size(); p < n; ++p)
+        if (la[p]->id() != lb[p]->id())
+          return false;
+      auto& va = a->intvars_valuation();
+      auto& vb = b->intvars_valuation();
+      for (unsigned v = 0, n = va.size(); v < n; ++v)
+        if (va[v] != vb[v])
+          return false;
+      return true;
+    }
+  };
+
+  tchecker::gc_t unused_gc;
+  typename ZONE::ts_t ts(*tcmd.model);
+  typename kripke_t::allocator_t
+    allocator(unused_gc, std::make_tuple(*tcmd.model, 100000),
+              std::tuple<>());
+  typename kripke_t::builder_t builder(ts, allocator);
+  // The value tells whether the state is waiting in TODO.  Declared
+  // after the allocator, so that states are released before the
+  // allocator is destroyed.
+  std::unordered_map<state_ptr_t, bool,
+                     discrete_hash, discrete_equal> seen;
+  std::deque<state_ptr_t> todo;
+
+  // Add ST to the hull of its discrete part, and return true if it
+  // satisfies BAD.  BAD only depends on the discrete part, so it is
+  // only evaluated on new discrete parts.
+  auto add = [&](const state_ptr_t& st) -> bool
+    {
+      auto [it, inserted] = seen.emplace(st, true);
+      if (inserted)
+        {
+          if (eval_boolean<kripke_t>(bad, props, *st))
+            return true;
+          todo.push_back(st);
+          return false;
+        }
+      auto& zone = it->first->zone();
+      auto* hull = zone.dbm();
+      const auto* dbm = st->zone().dbm();
+      bool grown = false;
+      for (unsigned i = 0, n = zone.dim() * zone.dim(); i < n; ++i)
+        if (dbm[i] > hull[i])
+          {
+            hull[i] = dbm[i];
+            grown = true;
+          }
+      if (grown && !it->second)
+        {
+          it->second = true;
+          todo.push_back(it->first);
+        }
+      return false;
+    };
+
+  bool res = false;
+  auto initial_range = builder.initial();
+  for (auto it = initial_range.begin(); !res && !it.at_end(); ++it)
+    res = add(std::get<0>(*it));
+  while (!res && !todo.empty())
+    {
+      state_ptr_t st = todo.front();
+      todo.pop_front();
+      seen[st] = false;
+      // If a successor has the same discrete part as ST, the zone of
+      // ST grows while its successors are computed.  They are then
+      // computed from a part of the hull, and ST is explored again.
+      auto range = builder.outgoing(st);
+      for (auto it = range.begin(); !res && !it.at_end(); ++it)
+        res = add(std::get<0>(*it));
+    }
+  todo.clear();
+  seen.clear();
+  return res;
+}
+
+bool tc_model::hull_reachable(spot::formula bad,
+                              zg_zone_semantics zone_sem) const
+{
+  if (zone_sem == digital)
+    return digital_model().hull_reachable(bad,
+                                          non_elapsed_no_extrapolation);
+  if (!bad.is_boolean())
+    throw std::runtime_error("hull_reachable() expects a Boolean formula");
+
+  std::map<spot::formula, one_prop> props;
+  std::ostringstream err;
+  bad.traverse([&](const spot::formula& f)
+               {
+                 if (!f.is(spot::op::ap))
+                   return false;
+                 if (one_prop p; parse_ap(f.ap_name(), *priv_->model,
+                                          p, err))
+                   props.emplace(f, p);
+                 return true;
+               });
+  if (!err.str().empty())
+    throw std::runtime_error(err.str());
+
+  switch (zone_sem)
+    {
+#define inst(ZONE) \
+    case ZONE: \
+      return hull_reachable_zg<tchecker::zg::ta::ZONE ## _t> \
+        (*priv_, bad, props);
+      inst(elapsed_no_extrapolation);
+      inst(elapsed_extraLU_global);
+      inst(elapsed_extraLU_local);
+      inst(elapsed_extraLUplus_global);
+      inst(elapsed_extraLUplus_local);
+      inst(elapsed_extraM_global);
+      inst(elapsed_extraM_local);
+      inst(elapsed_extraMplus_global);
+      inst(elapsed_extraMplus_local);
+      inst(non_elapsed_no_extrapolation);
+      inst(non_elapsed_extraLU_global);
+      inst(non_elapsed_extraLU_local);
+      inst(non_elapsed_extraLUplus_global);
+      inst(non_elapsed_extraLUplus_local);
+      inst(non_elapsed_extraM_global);
+      inst(non_elapsed_extraM_local);
+      inst(non_elapsed_extraMplus_global);
+      inst(non_elapsed_extraMplus_local);
+#undef inst
+    case digital:
+      // Handled above.
+      break;
+    }
+  return true;
+}
@@ -19,10 +19,18 @@
 
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <set>
 #include <string>
+#include <vector>
 
 #include <spot/tl/apcollect.hh>
+#include <spot/tl/exclusive.hh>
 #include <spot/kripke/kripke.hh>
+#include <spot/twa/twagraph.hh>
+#include <spot/twaalgos/emptiness.hh>
 #include <spot/tl/formula.hh>
 
 #ifdef TCLTL_BUILD
@@ -54,20 +62,382 @@ enum zg_zone_semantics
    non_elapsed_extraM_local,
    non_elapsed_extraMplus_global,
    non_elapsed_extraMplus_local,
+   // Integer clock values instead of zones (see tc_model::digital_model()),
+   // for closed models and stutter-invariant properties.
+   digital,
   };
 
+// Options for tc_model::kripke().  These are flags that may be
+// combined with |.
+enum kripke_options
+  {
+   kripke_default = 0,
+   // Only accept runs along which time diverges.  The Kripke
+   // structure then carries a Büchi acceptance condition marking the
+   // transitions that are guaranteed to let at least one time unit
+   // elapse, so that any emptiness check that honors the acceptance
+   // of its operands rejects Zeno cycles.
+   kripke_non_zeno = 1,
+   // Symmetry reduction.  Processes that are copies of each other
+   // (like P1, P2, P3 with clocks x1, x2, x3) are detected from the
+   // declarations of the model, and each state is replaced by a
+   // representative of the states obtained by permuting these
+   // processes, so that symmetric states are explored only once.
+   // Processes that appear in the atomic propositions to observe are
+   // not permuted.  Runs of the resulting Kripke structure are runs of
+   // the model only up to such permutations.
+   kripke_symmetry = 2,
+   // Partial-order reduction.  In states where some process can only
+   // take edges that are independent from the rest of the system and
+   // do not change the observed atomic propositions, only the
+   // transitions of that process are explored.  This preserves the
+   // stutter-invariant properties (i.e., LTL without X) over the
+   // observed propositions, and only those.  Edges that involve
+   // clocks or synchronizations are never reduced.
+   kripke_por = 4,
+   // Stutter-step collapsing.  The successors of a state are the
+   // first states with a different labeling that are reachable
+   // through transitions that do not change the labeling (plus a
+   // self-loop if such transitions can be taken forever), so that
+   // sequences of steps invisible to the observed propositions are
+   // not part of the Kripke structure.  This only preserves
+   // stutter-invariant properties.  It is ignored when
+   // kripke_non_zeno is used.
+   kripke_stutter = 8,
+   // Reset dead variables.  An integer variable is dead in a state if
+   // no process can read it before writing it, according to a static
+   // analysis of the model.  The value of such variables cannot
+   // influence the future, so they are set to their initial value,
+   // merging states that only differed by them.  Variables observed
+   // by atomic propositions are never reset.
+   kripke_dead_vars = 16,
+   // Free inactive clocks.  A clock is inactive in a state if no
+   // process can read it (in a guard or an invariant) before
+   // resetting it, according to a static analysis of the model.  All
+   // constraints on such clocks are removed from the zone, merging
+   // states whose zones only differed on them.  TChecker's DBMs have a
+   // fixed dimension, so the rows and columns of inactive clocks are
+   // still stored.  This is ignored when kripke_non_zeno is used,
+   // since the detection of time progress looks at the values of the
+   // clocks that are reset.
+   kripke_active_clocks = 32,
+  };
+
+// The memory used by one kind of objects: how many are currently
+// allocated, their total size, and the largest size reached so far.
+struct TCLTL_API tc_memory_stats final
+{
+  uint64_t objects = 0;
+  uint64_t bytes = 0;
+  uint64_t peak_bytes = 0;
+
+  void allocate(uint64_t size)
+  {
+    ++objects;
+    bytes += size;
+    if (bytes > peak_bytes)
+      peak_bytes = bytes;
+  }
+
+  void deallocate(uint64_t size)
+  {
+    --objects;
+    bytes -= size;
+  }
+};
+
+// Statistics about the Kripke structures returned by
+// tc_model::kripke().  They are attached to the Kripke structure as
+// its "tcltl-stats" named property, and updated as it is explored:
+//
+//   auto* s = k->get_named_prop<tc_kripke_stats>("tcltl-stats");
+struct TCLTL_API tc_kripke_stats final
+{
+  // Number of clocks of the model.
+  unsigned clocks = 0;
+  // Number of states built, i.e., initial states and successors,
+  // counting a state each time it is reached.
+  uint64_t states = 0;
+  // Sum of the number of active clocks (see kripke_active_clocks)
+  // over these states.  Without kripke_active_clocks, all clocks are
+  // counted as active.
+  uint64_t active_clocks = 0;
+  // The states of the zone graph built by TChecker: their DBMs,
+  // locations and integer variables.  The sizes do not include the
+  // overhead of TChecker's pools.
+  tc_memory_stats zones;
+  // Those of the zones that are no longer used by the Kripke
+  // structure, but wait to be released until TChecker's iterators
+  // stop referencing them.
+  tc_memory_stats pending_zones;
+  // The states of the Kripke structure, which wrap the zones and are
+  // allocated from a spot::fixed_size_pool.
+  tc_memory_stats kripke_states;
+  // The states of the product built by lazy_intersecting_run() and
+  // the other searches of this library, most of which are held by
+  // the hash table of the search.
+  tc_memory_stats product_states;
+  // If set, called every 65536 states built, e.g., to report
+  // progress.
+  std::function<void(const tc_kripke_stats&)> progress;
+};
+
+// A concrete timed run matching a run of a Kripke structure built by
+// tc_model::kripke() (see tc_kripke::timed_run()).  All times are
+// given as multiples of 1/denominator, so that they are exact.
+struct TCLTL_API tc_timed_step
+{
+  // The name of each process, with the name of its location.
+  std::vector<std::pair<std::string, std::string>> locations;
+  // The value of each clock when the state is entered.
+  std::vector<int64_t> clocks;
+  // The time spent in the state before the next step.
+  int64_t delay = 0;
+};
+
+struct TCLTL_API tc_timed_run
+{
+  // The names of the clocks, in the order of tc_timed_step::clocks.
+  std::vector<std::string> clocks;
+  int64_t denominator = 1;
+  std::vector<tc_timed_step> prefix;
+  std::vector<tc_timed_step> cycle;
+  // Whether the clocks have the same values at the end of the cycle
+  // as at its start, so that repeating the cycle gives an infinite
+  // timed run.  Otherwise the cycle is only shown once.
+  bool repeatable = false;
+};
+
+// Print R as a JSON object with the same fields as tc_timed_run.
+TCLTL_API void print_timed_run(std::ostream& out, const tc_timed_run& r);
+
+// The Kripke structures returned by tc_model::kripke() implement
+// this interface, which lets a product with a property automaton
+// evaluate only the atomic propositions that the automaton needs
+// (see lazy_intersecting_run()).
+class TCLTL_API tc_kripke: public spot::kripke
+{
+public:
+  tc_kripke(const spot::bdd_dict_ptr& dict)
+    : spot::kripke(dict)
+  {
+  }
+
+  // Like state_condition(S), but only evaluate the atomic
+  // propositions whose BDD variables appear in SUPPORT (a conjunction
+  // of variables, as returned by bdd_support()).  The other
+  // propositions are left unconstrained.
+  virtual bdd state_condition(const spot::state* s, bdd support) const = 0;
+
+  // Like succ_iter(S), but the condition of the transitions is based
+  // on state_condition(S, SUPPORT).
+  virtual spot::twa_succ_iterator*
+  succ_iter(const spot::state* s, bdd support) const = 0;
 
+  // An estimate of the number of transitions needed from S to reach
+  // a state where some of the atomic propositions whose variables
+  // appear in SUPPORT hold.  This is used as the heuristic of
+  // guided_intersecting_run(), and does not have to be exact: smaller
+  // values just mean that S should be explored first.
+  virtual unsigned distance(const spot::state* s, bdd support) const = 0;
+
+  // The name of each process, with the name of its location in S.
+  virtual std::vector<std::pair<std::string, std::string>>
+  locations(const spot::state* s) const = 0;
+
+  // The name of each integer variable (as "a[i]" for the cells of
+  // arrays), with its value in S.
+  virtual std::vector<std::pair<std::string, int>>
+  intvars(const spot::state* s) const = 0;
+
+  // Compute the delays and the values of the clocks along RUN, a run
+  // of this Kripke structure, such as a counterexample.  Only the
+  // successors of the states of RUN are built again, to recover the
+  // guards, invariants and resets of its transitions.  This throws
+  // std::runtime_error if RUN has no timed counterpart, or if its
+  // steps are not transitions of the model (as with kripke_stutter
+  // or kripke_symmetry).
+  virtual tc_timed_run timed_run(const spot::twa_run& run) const = 0;
+
+  using spot::kripke::state_condition;
+  using spot::kripke::succ_iter;
+};
+
+// The state space explored by tc_model::explore(), i.e., the zone
+// graph restricted to the discrete part of each state.
+//
+// States are numbered from 0 in the order they are discovered by a
+// breadth-first search, and the initial states come first.  The
+// graph is stored in compressed sparse row (CSR) format: the
+// successors of state s are succ[offsets[s]], ...,
+// succ[offsets[s + 1] - 1].  For each state s, the location of
+// process p is locations[s * num_processes + p], and the value of
+// integer variable v is intvars[s * num_intvars + v].  Locations
+// and variables are numbered in the order in which
+// tc_model::dump_info() lists them.
+struct TCLTL_API tc_state_space final
+{
+  unsigned num_states = 0;
+  unsigned num_initial = 0;
+  unsigned num_processes = 0;
+  unsigned num_intvars = 0;
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> succ;
+  std::vector<uint32_t> locations;
+  std::vector<int32_t> intvars;
+};
+typedef std::shared_ptr<tc_state_space> tc_state_space_ptr;
+
+// The results of tc_model::simulate().  The vectors are indexed like
+// the atomic propositions given to simulate().
+struct TCLTL_API tc_simulation final
+{
+  uint64_t runs = 0;
+  // Total number of transitions taken.
+  uint64_t steps = 0;
+  // Number of runs that reached a state from which no transition
+  // could be taken, before the bound on their length.
+  uint64_t deadlocks = 0;
+  // Number of runs in which each proposition held at least once, and
+  // number of states of the runs (including their initial states) in
+  // which it held.
+  std::vector<uint64_t> runs_holding;
+  std::vector<uint64_t> states_holding;
+};
+
+// Output formats for export_kripke().
+enum export_format
+  {
+   // GraphViz's format.
+   export_dot,
+   // The Hanoi Omega-Automata format (with state-based labels).
+   export_hoa,
+   // A compact binary format, see export_kripke().
+   export_binary,
+  };
+
+// Write the state space of K to OUT, as it is explored.
+//
+// Contrary to spot::print_dot() or spot::print_hoa(), which first
+// convert their argument into an explicit twa_graph, this performs a
+// breadth-first search of K and writes each state and its outgoing
+// transitions as soon as they are discovered.  Only the map from
+// states to their numbers is kept in memory.  States are numbered
+// in the order in which they are discovered, and the initial state
+// is 0.  NAME, if not empty, is used as a title for the output.
+//
+// Because the number of states is only known at the end, the HOA
+// output has no "States:" header.
+//
+// The binary format uses little-endian unsigned 32-bit integers
+// (u32) throughout.  It starts with the 8 bytes "TCLTLKS1", followed
+// by the number of atomic propositions, the number of acceptance
+// sets (0 unless K was built with kripke_non_zeno), and the name of
+// each atomic proposition as a u32 length followed by the bytes of
+// the name.  Then, for each state in order, come two bitsets of
+// ceil(#AP/8) bytes each, giving the atomic propositions that are
+// true and false in the state (bit i of byte j stands for
+// proposition 8j+i), the number of successors, and for each
+// successor its number, followed by the bitset of its acceptance
+// sets (as a u32) if there are any.
+TCLTL_API void export_kripke(std::ostream& out, const spot::const_kripke_ptr& k,
+                             export_format fmt, const std::string& name = "");
+
+// Search for a run of K that is accepted by AUT, i.e., a
+// counterexample if AUT is the automaton of the negation of the
+// property.  Return nullptr if there is none.
+//
+// This is equivalent to K->intersecting_run(AUT), except that the
+// product is built in a way that, if K was built by
+// tc_model::kripke(), only evaluates the atomic propositions that
+// appear on the transitions leaving the current state of AUT, instead
+// of all the propositions observed by K.  The steps of the returned
+// run are labeled by the complete conditions of the states of K.
+// AUT should not use Fin acceptance.
+TCLTL_API spot::twa_run_ptr
+lazy_intersecting_run(const spot::const_kripke_ptr& k,
+                      const spot::const_twa_graph_ptr& aut);
+
+// Like lazy_intersecting_run(), but for finding counterexamples
+// quickly.  When AUT is terminal (as for the negation of safety
+// properties), an accepting run exists as soon as the product reaches
+// an accepting SCC of AUT.  In that case, the product is explored by
+// a best-first search, where the states of K that seem closer (see
+// tc_kripke::distance()) to satisfying the propositions (locations
+// or comparisons of variables) mentioned on the transitions that make
+// AUT progress are explored first.  The
+// counterexample found is not necessarily the shortest one.
+//
+// Otherwise, or if K has acceptance sets, or was not built by
+// tc_model::kripke(), this is just lazy_intersecting_run().
+TCLTL_API spot::twa_run_ptr
+guided_intersecting_run(const spot::const_kripke_ptr& k,
+                        const spot::const_twa_graph_ptr& aut);
+
+// Like lazy_intersecting_run(), but only look for counterexamples
+// whose states can all be reached from the initial state of K in at
+// most DEPTH transitions.  The product is explored breadth-first one
+// level at a time, and the emptiness of the explored part is checked
+// again whenever a level adds a transition that may close a cycle,
+// so the counterexample returned is one of the shallowest.  If
+// COMPLETE is given, it is set to true when there is no counterexample
+// and the whole product was explored within DEPTH, i.e., when the
+// absence of counterexample is not due to the bound.
+TCLTL_API spot::twa_run_ptr
+bounded_intersecting_run(const spot::const_kripke_ptr& k,
+                         const spot::const_twa_graph_ptr& aut,
+                         unsigned depth, bool* complete = nullptr);
+
+// Return an accepting run of A whose prefix is as short as possible,
+// followed by a short accepting cycle (the shortest one when A has at
+// most one acceptance set), or nullptr if there is none.  The
+// reachable part of A is explored once and stored, and the run is
+// computed by breadth-first searches over that copy.  A should not
+// use Fin acceptance.
+TCLTL_API spot::twa_run_ptr
+shortest_accepting_run(const spot::const_twa_ptr& a);
+
+// Like lazy_intersecting_run(), but return the run of K given by
+// shortest_accepting_run() on the product.
+TCLTL_API spot::twa_run_ptr
+shortest_intersecting_run(const spot::const_kripke_ptr& k,
+                          const spot::const_twa_graph_ptr& aut);
+
+// Thread safety:
+//
+// Models may be loaded from several threads concurrently.  TChecker's
+// parser is not reentrant, so load() serializes the parsing and
+// instantiation of models internally; callers need no locking.
+//
+// Once loaded, the TChecker model held by a tc_model is never
+// modified, and explore() only reads it: several threads may call
+// explore() on the same tc_model (or on different ones) at the same
+// time, and each call gets its own transition system and allocators.
+//
+// On the other hand, kripke() and anything that uses the resulting
+// Kripke structure (products, emptiness checks, printing) manipulate
+// BDDs, and BuDDy, the BDD library used by Spot, has global state
+// that is not protected against concurrent accesses.  Those have to
+// be called from one thread at a time, which is why the Python
+// bindings keep the GIL during these calls.  Finally get_logs()
+// should not be called on the same tc_model from two threads at
+// once.
 class TCLTL_API tc_model final
 {
 private:
   tc_model_details_ptr priv_;
-  tc_model(tc_model_details*);
+  mutable std::string logs_;
+  tc_model(tc_model_details_ptr);
 public:
   // Load a TChecker model.
   //
   // This will throw an exception on error.
   static tc_model load(const std::string filename);
 
+  // Load a TChecker model from its text.
+  //
+  // This will throw an exception on error.
+  static tc_model load_from_string(const std::string& text);
 
   // Return any warnings that was output while instantiating the
   // model.  Calling this function will clear the logs.
@@ -97,9 +467,118 @@ public:
   // \a dead an atomic proposition or constant to use for looping on
   //         dead states
   // \a zone_sem the zone semantics that TChecker should use
+  // \a opts a combination of kripke_options
   spot::kripke_ptr kripke(const spot::atomic_prop_set* to_observe,
                           spot::bdd_dict_ptr dict,
                           spot::formula dead = spot::formula::tt(),
                           zg_zone_semantics zone_sem =
-                          elapsed_extraLUplus_local);
+                          elapsed_extraLUplus_local,
+                          unsigned opts = kripke_default);
+
+  // Return the groups of atomic propositions of APS that are
+  // mutually exclusive on this model: those that give different
+  // locations to the same process (like "P.a" and "P.b"), and those
+  // that compare the same variable for equality with different
+  // constants (like "x==1" and "x==2").  These can be used to remove
+  // unsatisfiable transitions from the automaton of a formula before
+  // building its product with the Kripke structure.  Propositions
+  // that cannot be parsed are ignored.
+  spot::exclusive_ap exclusive_aps(const spot::atomic_prop_set* aps) const;
+
+  // Rewrite the atomic propositions of F that compare a variable to
+  // a constant, so that complementary propositions use the same
+  // atomic proposition: "x!=1" becomes "!(x==1)", a bare "x" becomes
+  // "!(x==0)", and the other comparisons become "x<=c" or "!(x<=c)"
+  // (e.g., "x<3" is "x<=2" and "x>=3" is "!(x<=2)").  This reduces
+  // the number of propositions seen by the translator and evaluated
+  // on each state.  DEAD, and the propositions that are not
+  // comparisons of a variable, are kept unchanged.
+  spot::formula normalize_aps(spot::formula f,
+                              spot::formula dead = spot::formula::tt()) const;
+
+  // Return the model obtained by removing all clocks except those in
+  // KEEP from this one (see tc_untimed_model() in modelinfo.hh).  It
+  // has all the runs of this model and possibly more, so a formula
+  // that holds on it also holds on this model, and checking it is
+  // much cheaper.  If STUTTER is set, every state of the abstraction
+  // can also loop, as needed to cover the loops added on dead states
+  // by kripke() when its DEAD argument is true.  This throws if the
+  // abstraction cannot be built (STUTTER is incompatible with
+  // committed locations).
+  tc_model untimed_abstraction(bool stutter,
+                               const std::set<std::string>& keep = {}) const;
+
+  // Return the model obtained by giving integer values to the clocks
+  // of this one (see tc_digital_model() in modelinfo.hh): clocks
+  // become bounded integer variables, and time elapses one unit at a
+  // time.  For closed models (without strict clock constraints), the
+  // integer instants are enough to decide stutter-invariant
+  // properties; the ticks and clock increments are visible steps that
+  // do not change the locations, so other properties can tell the
+  // difference.  The result is still explored with TChecker's zone
+  // graph, but its zones only have the reference clock, so that each
+  // discrete state has a single zone; this pays off when the clock
+  // constants are small.  The kripke(), explore() and simulate()
+  // methods use it with the "digital" zone semantics.  This throws if
+  // the model is not closed, has constraints between two clocks, or
+  // compares or sets a clock to anything but an integer literal.
+  tc_model digital_model() const;
+
+  // Refine an untimed abstraction of this model along one of its
+  // counterexamples.  RUN should be a run of a Kripke structure built
+  // from untimed_abstraction(STUTTER, KEPT) of this model, without
+  // kripke_stutter, kripke_symmetry or kripke_dead_vars (so that its
+  // steps are transitions of the model), and with DEAD as the
+  // proposition of dead states.  The sequence of locations and
+  // integer values of RUN is replayed on the zone graph of this model
+  // (repeating the cycle until the sets of states reached at its
+  // start repeat).  If it can be followed, RUN is genuine and the
+  // result is empty.  Otherwise RUN is spurious, and the result is a
+  // set of clocks, not in KEPT, that makes the prefix of RUN up to
+  // its first infeasible step infeasible once added to the
+  // abstraction.  This set is minimal: each of its clocks is needed.
+  std::set<std::string>
+  refine_clocks(const spot::twa_run& run, const std::set<std::string>& kept,
+                spot::formula dead = spot::formula::tt()) const;
+
+  // Explore the entire zone graph of the model, and return its
+  // discrete part as a tc_state_space.
+  //
+  // Contrary to kripke(), this does not involve Spot or BDDs at all,
+  // so that it is cheap enough to be used for statistics on large
+  // state spaces.
+  tc_state_space_ptr explore(zg_zone_semantics zone_sem =
+                             elapsed_extraLUplus_local) const;
+
+  // Perform RUNS random walks of at most STEPS transitions, and
+  // count how often each of the atomic propositions PROPS (in the
+  // syntax of kripke()) holds.  The walks follow concrete clock
+  // values: each step picks uniformly one of the transitions that can
+  // be taken after some delay from the current clock values, then a
+  // delay uniformly among those that allow it (or, if they are not
+  // bounded, the smallest one plus a delay of exponential
+  // distribution with mean 1).  A walk deadlocks when no transition
+  // can be taken after any delay.  ZONE_SEM is only used to compute
+  // the discrete successors of each state, except that the "digital"
+  // semantics walks through digital_model().  The walks are distributed
+  // over THREADS threads; walk number i uses SEED + i as its seed,
+  // so the result does not depend on THREADS.  Like explore(), this
+  // does not use BDDs, and may be called from several threads.
+  tc_simulation simulate(const std::vector<std::string>& props,
+                         uint64_t runs, unsigned steps,
+                         uint64_t seed = 0, unsigned threads = 1,
+                         zg_zone_semantics zone_sem =
+                         elapsed_extraLUplus_local) const;
+
+  // Whether a state satisfying the Boolean formula BAD (over atomic
+  // propositions in the syntax of kripke()) may be reachable.  All
+  // the zones with the same discrete part are merged into their
+  // convex hull, as in Uppaal's convex-hull approximation, so this
+  // explores at most one zone per discrete state.  This
+  // over-approximates the reachable states: false means that BAD is
+  // definitely unreachable, and so that G(!BAD) holds, while true
+  // only means that an exact exploration is needed.
+  bool hull_reachable(spot::formula bad,
+                      zg_zone_semantics zone_sem =
+                      elapsed_extraLUplus_local) const;
 };
@@ -59,3 +59,28 @@ try:
     satisfies(model, 'G(arbiter1.req | foo)')
 except RuntimeError as e:
     assert "foo" in str(e)
+
+g = model.explore()
+assert g.num_initial == 1
+assert g.num_processes == 3
+assert g.num_intvars == 1
+assert len(g.offsets_buffer()) == 4 * (g.num_states + 1)
+assert len(g.locations_buffer()) == 4 * g.num_states * g.num_processes
+try:
+    import numpy
+except ImportError:
+    pass
+else:
+    a = g.arrays()
+    del g
+    assert a['offsets'][-1] == len(a['succ'])
+    assert a['succ'].max() < len(a['offsets']) - 1
+    assert a['locations'].shape == (len(a['offsets']) - 1, 3)
+    # the "id" variable is either 0 or 1
+    assert set(numpy.unique(a['intvars'])) <= {0, 1}
+
+# explore() releases the GIL, so it can run in parallel threads.
+from concurrent.futures import ThreadPoolExecutor
+with ThreadPoolExecutor(4) as pool:
+    sizes = list(pool.map(lambda _: model.explore().num_states, range(8)))
+assert len(set(sizes)) == 1